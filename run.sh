@@ -1,8 +1,5 @@
 #!/bin/sh
 
-# Remove stall socket here
-rm -f /tmp/libTAS.socket
-
 Usage ()
 {
     echo "Usage: ./run.sh [options] game_executable_path [game_cmdline_arguments]"
@@ -10,6 +7,26 @@ Usage ()
     echo "  -d, --dump FILE     Start a audio/video encode into the specified FILE"
     echo "  -r, --read MOVIE    Play game inputs from MOVIE file"
     echo "  -w, --write MOVIE   Record game inputs into the specified MOVIE file"
+    echo "  -p, --prefetch N    When playing back a movie, send inputs up to N frames"
+    echo "                      ahead of time, so that the game does not wait for them"
+    echo "  -b, --batch         Play back the movie given with -r without any window"
+    echo "                      nor user interaction, as fast as possible, and exit"
+    echo "                      at the end of the movie with a non-zero status on error"
+    echo "  -t, --turbo         Run the game as fast as possible, without drawing,"
+    echo "                      playing sound nor sleeping (implied by --batch)"
+    echo "  -s, --timestats FILE"
+    echo "                      Write the number of time queries of each type made"
+    echo "                      by the game at each frame into FILE, in CSV format"
+    echo "                      (use - for the standard output)"
+    echo "  -m, --memstats FILE Write the statistics of the memory manager of libTAS"
+    echo "                      at each frame into FILE, in CSV format"
+    echo "                      (use - for the standard output). Needs the custom"
+    echo "                      memory manager, enabled in src/shared/Config.cpp"
+    echo "  -a, --alloctrace FILE"
+    echo "                      Record all the allocations of the game into FILE,"
+    echo "                      to be replayed by build/benchallocator"
+    echo "  -n, --instances N   Launch N instances of the game at the same time, each"
+    echo "                      one with its own linTAS program"
     echo "  -l, --lib     PATH  Manually import a library"
     echo "  -L, --libpath PATH  Indicate a path to additional libraries the game"
     echo "                      will want to import."
@@ -21,6 +38,13 @@ Usage ()
 gamepath=
 movieopt=
 dumpopt=
+prefetchopt=
+batchopt=
+turboopt=
+statsopt=
+memstatsopt=
+alloctrace=
+instances=1
 libdir=
 rundir=
 SHLIBS=
@@ -41,6 +65,29 @@ do
     -w | --write)   shift
                     movieopt="-w $1"
                     ;;
+    -p | --prefetch) shift
+                    prefetchopt="-p $1"
+                    ;;
+    -b | --batch)   batchopt="-b"
+                    ;;
+    -t | --turbo)   turboopt="-t"
+                    ;;
+    -s | --timestats) shift
+                    statsopt="-s $1"
+                    ;;
+    -m | --memstats) shift
+                    memstatsopt="-m $1"
+                    ;;
+    -a | --alloctrace) shift
+                    # The game is launched from another directory
+                    case "$1" in
+                        /*) alloctrace=$1 ;;
+                        *)  alloctrace=$PWD/$1 ;;
+                    esac
+                    ;;
+    -n | --instances) shift
+                    instances=$1
+                    ;;
     -l | --lib)     shift
                     SHLIBS="${SHLIBS} -l $1"
                     ;;
@@ -87,13 +134,65 @@ while read lib
 do SHLIBS="$SHLIBS -l $lib"
 done < $mypipe
 
-# Launching the game with the libTAS library as LD_PRELOAD
-echo "LD_PRELOAD=$OLDPWD/build/libTAS.so $OLDPWD/$gamepath $@ &"
-LD_PRELOAD=$OLDPWD/build/libTAS.so "$OLDPWD/$gamepath" "$@" &
-cd - > /dev/null
-sleep 1
+# Launch the game and linTAS for one instance.
+# First argument is the instance identifier, or empty for a single instance.
+# The other arguments are passed to the game.
+launch_instance ()
+{
+    if [ -z "$1" ]
+    then
+        socketfile=/tmp/libTAS.socket
+    else
+        export LIBTAS_INSTANCE=$1
+        socketfile=/tmp/libTAS-$1.socket
+    fi
+    shift
+
+    # The allocation trace is read by libTAS when the game starts
+    if [ -n "$alloctrace" ]
+    then
+        if [ -z "$LIBTAS_INSTANCE" ]
+        then
+            export LIBTAS_ALLOC_TRACE=$alloctrace
+        else
+            export LIBTAS_ALLOC_TRACE=$alloctrace-$LIBTAS_INSTANCE
+        fi
+    fi
+
+    # Remove stall socket here
+    rm -f $socketfile
 
-# Launch the TAS program
-echo "./build/linTAS $SHLIBS $movieopt $dumpopt"
-./build/linTAS $SHLIBS $movieopt $dumpopt
+    # Launching the game with the libTAS library as LD_PRELOAD
+    echo "LD_PRELOAD=$OLDPWD/build/libTAS.so $OLDPWD/$gamepath $@ &"
+    LD_PRELOAD=$OLDPWD/build/libTAS.so "$OLDPWD/$gamepath" "$@" &
+    cd - > /dev/null
+
+    # Launch the TAS program. It waits for the game socket to be created.
+    echo "./build/linTAS $SHLIBS $movieopt $dumpopt $prefetchopt $batchopt $turboopt $statsopt $memstatsopt"
+    ./build/linTAS $SHLIBS $movieopt $dumpopt $prefetchopt $batchopt $turboopt $statsopt $memstatsopt
+}
+
+if [ "$instances" -le 1 ]
+then
+    launch_instance "" "$@"
+    exit $?
+fi
+
+# Launch all instances in parallel, and wait for all of them to finish
+pids=
+i=1
+while [ $i -le $instances ]
+do
+    ( launch_instance $i "$@" ) &
+    pids="$pids $!"
+    i=$((i + 1))
+done
+
+failed=0
+for pid in $pids
+do
+    wait $pid || failed=$((failed + 1))
+done
 
+echo "$failed instance(s) out of $instances failed"
+[ $failed -eq 0 ]
@@ -28,12 +28,134 @@
 #include "audio/AudioContext.h"
 #include "ThreadState.h"
 #include "renderhud/RenderHUD.h"
+#include "timer.h" // fireSDLTimers
 
+/* Number of time queries of a non-main thread during a frame before its
+ * own clock starts advancing */
 #define MAX_NONFRAME_GETTIMES 4000
 
+/* Time query statistics of a non-main thread. The thread increments them,
+ * and the main thread takes them at each frame boundary, so that they are
+ * reported for the right frame even if the thread stops querying the time.
+ */
+struct ThreadCallCounts {
+    std::atomic<uint32_t> calls[TIMETYPE_NUMTRACKEDTYPES];
+    std::atomic<uint32_t> advances;
+};
+
+/* Statistics of the first non-main threads that query the time. The last
+ * record is shared by all the later threads. Records are never reused, so
+ * that the numbering of the threads does not change.
+ */
+static ThreadCallCounts threadCounts[TIMECALLSTATS_MAXTHREADS + 1];
+static std::atomic<unsigned int> numCountedThreads;
+
+/* Deterministic clock of a non-main thread.
+ * It follows the main timer, but a thread that queries the time too many
+ * times during a frame (e.g. a busy-wait loop) advances its own clock
+ * instead of the shared one, by at most one frame duration per frame.
+ * Only zero-initialized members, so that no constructor runs on each thread.
+ */
+struct ThreadClock {
+    /* Frame index when the counters below were reset */
+    unsigned long frame;
+
+    /* Number of tracked time queries during this frame */
+    unsigned int getTimes;
+
+    /* Statistics record of the thread, set on its first tracked query */
+    ThreadCallCounts* counts;
+
+    /* How much this thread advanced its clock during this frame */
+    TimeHolder extraTicks;
+
+    /* Last returned value, so that the clock never goes backwards */
+    TimeHolder lastTicks;
+};
+
+static thread_local ThreadClock threadClock;
+
+void DeterministicTimer::publishTicks(void)
+{
+    TimeHolder fakeTicks = ticks + fakeExtraTicks;
+
+    unsigned int seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    publishedSec.store(fakeTicks.tv_sec, std::memory_order_relaxed);
+    publishedNsec.store(fakeTicks.tv_nsec, std::memory_order_relaxed);
+
+    sequence.store(seq + 2, std::memory_order_release);
+}
+
+TimeHolder DeterministicTimer::readTicks(void)
+{
+    TimeHolder fakeTicks;
+    unsigned int seq;
+
+    do {
+        seq = sequence.load(std::memory_order_acquire);
+        fakeTicks.tv_sec = publishedSec.load(std::memory_order_relaxed);
+        fakeTicks.tv_nsec = publishedNsec.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || (seq != sequence.load(std::memory_order_relaxed)));
+
+    return fakeTicks;
+}
+
+TimeHolder DeterministicTimer::getThreadTicks(TimeCallType type)
+{
+    /* Reset the budget of the thread on each new frame */
+    unsigned long frame = frameIndex.load(std::memory_order_relaxed);
+    if (threadClock.frame != frame) {
+        threadClock.frame = frame;
+        threadClock.getTimes = 0;
+        threadClock.extraTicks.tv_sec = 0;
+        threadClock.extraTicks.tv_nsec = 0;
+    }
+
+    if (type != TIMETYPE_UNTRACKED) {
+        /* If the thread gets the time too many times, it may be waiting
+         * for the time to advance, so we advance its own clock by 1 ms
+         * every few calls, as long as it stays within one frame duration.
+         * This avoids freezes in games that expect the time to advance in
+         * other threads, without modifying the timer of the main thread.
+         */
+        if (!threadClock.counts) {
+            unsigned int index = numCountedThreads.fetch_add(1, std::memory_order_relaxed);
+            threadClock.counts = &threadCounts[(index < TIMECALLSTATS_MAXTHREADS) ? index : TIMECALLSTATS_MAXTHREADS];
+        }
+
+        unsigned int times = threadClock.getTimes++;
+        threadClock.counts->calls[type].fetch_add(1, std::memory_order_relaxed);
+        if ((times >= MAX_NONFRAME_GETTIMES) &&
+            !((times - MAX_NONFRAME_GETTIMES) % altGetTimeLimits[type])) {
+
+            TimeHolder budget;
+            budget.tv_sec = 0;
+            budget.tv_nsec = 1000000000 / tasflags.framerate;
+
+            if (budget > threadClock.extraTicks) {
+                if (times == MAX_NONFRAME_GETTIMES)
+                    debuglog(LCF_TIMEGET | LCF_FREQUENT, "Advancing the clock of a non-main thread");
+                struct timespec delta = {0, 1000000};
+                threadClock.extraTicks += delta;
+                threadClock.counts->advances.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    TimeHolder threadTicks = readTicks() + threadClock.extraTicks;
+    if (threadClock.lastTicks > threadTicks)
+        return threadClock.lastTicks;
+
+    threadClock.lastTicks = threadTicks;
+    return threadTicks;
+}
+
 struct timespec DeterministicTimer::getTicks(TimeCallType type=TIMETYPE_UNTRACKED)
 {
-    //std::lock_guard<std::mutex> lock(mutex);
     DEBUGLOGCALL(LCF_TIMEGET | LCF_FREQUENT);
 
     /* If we are in the native thread state, just return the real time */
@@ -47,77 +169,53 @@ struct timespec DeterministicTimer::getTicks(TimeCallType type=TIMETYPE_UNTRACKE
         return nonDetTimer.getTicks(); // 0 framerate means disable deterministic timer
     }
 
-    bool isFrameThread = isMainThread();
-
     /* If it is our own code calling this, we don't need to track the call */
     if (threadState.isOwnCode())
         type = TIMETYPE_UNTRACKED;
 
-    /* Only the main thread can modify the timer */
-    if(!isFrameThread) {
-        if(type != TIMETYPE_UNTRACKED) {
+    /* Only the main thread can modify the timer, so as to not dirty it
+     * with nondeterministic values. Other threads use their own clock.
+     */
+    if (!isMainThread())
+        return getThreadTicks(type);
 
-            /* Well, actually, if another thread get the time too many times,
-             * we temporarily consider it as the main thread.
-             * This can lead to desyncs, but it avoids freeze in games that
-             * expect the time to advance in other threads.
-             */
-            if(getTimes >= MAX_NONFRAME_GETTIMES)
-            {
-                if(getTimes == MAX_NONFRAME_GETTIMES)
-                    debuglog(LCF_TIMEGET | LCF_DESYNC, "Temporarily assuming main thread");
-                isFrameThread = true;
-            }
-            getTimes++;
-        }
-    }
+    int ticksExtra = 0;
 
-    if (isFrameThread)
+    if (type != TIMETYPE_UNTRACKED)
     {
-        /* Only do this in the main thread so as to not dirty the timer with nondeterministic values
-         * (not to mention it would be extremely multithreading-unsafe without using sync primitives otherwise)
-         */
-
-        int ticksExtra = 0;
-
-        if (type != TIMETYPE_UNTRACKED)
-        {
-            debuglog(LCF_TIMESET | LCF_FREQUENT, "subticks ", type, " increased");
-            altGetTimes[type]++;
-
-            if(altGetTimes[type] > altGetTimeLimits[type]) {
-                /* 
-                 * We reached the limit of the number of calls.
-                 * We advance the deterministic timer by some value
-                 */
-                int tickDelta = 1;
+        debuglog(LCF_TIMESET | LCF_FREQUENT, "subticks ", type, " increased");
+        stats.mainCalls[type]++;
+        if(altGetTimes[type].fetch_add(1, std::memory_order_relaxed) >= altGetTimeLimits[type]) {
+            /* 
+             * We reached the limit of the number of calls.
+             * We advance the deterministic timer by some value
+             */
+            int tickDelta = 1;
 
-                debuglog(LCF_TIMESET | LCF_FREQUENT, "WARNING! force-advancing time of type ", type);
+            debuglog(LCF_TIMESET | LCF_FREQUENT, "WARNING! force-advancing time of type ", type);
 
-                ticksExtra += tickDelta;
+            ticksExtra += tickDelta;
+            stats.forceAdvances++;
 
-                /* Reseting the number of calls from all functions */
-                for (int i = 0; i < TIMETYPE_NUMTRACKEDTYPES; i++)
-                    altGetTimes[i] = 0;
+            /* Reseting the number of calls from all functions */
+            for (int i = 0; i < TIMETYPE_NUMTRACKEDTYPES; i++)
+                altGetTimes[i].store(0, std::memory_order_relaxed);
 
-            }
         }
+    }
 
-        if(ticksExtra) {
-            /* Delay by ticksExtra ms. Arbitrary */
-            struct timespec delay = {0, ticksExtra * 1000000};
-            addDelay(delay);
-        }
+    if(ticksExtra) {
+        /* Delay by ticksExtra ms. Arbitrary */
+        struct timespec delay = {0, ticksExtra * 1000000};
+        addDelay(delay);
     }
 
-    TimeHolder fakeTicks = ticks + fakeExtraTicks;
-    return fakeTicks;
+    return readTicks();
 }
 
 
 void DeterministicTimer::addDelay(struct timespec delayTicks)
 {
-    //std::lock_guard<std::mutex> lock(mutex);
     debuglog(LCF_TIMESET | LCF_SLEEP, __func__, " call with delay ", delayTicks.tv_sec * 1000000000 + delayTicks.tv_nsec, " nsec");
 
     if(tasflags.framerate == 0) // 0 framerate means disable deterministic timer
@@ -127,6 +225,9 @@ void DeterministicTimer::addDelay(struct timespec delayTicks)
     if (threadState.isOwnCode())
         return;
 
+    stats.delayCalls++;
+    stats.delayTotal += delayTicks.tv_sec * 1000000000ULL + delayTicks.tv_nsec;
+
     /* Deferring as much of the delay as possible
      * until the place where the regular per-frame delay is applied
      * gives the smoothest results.
@@ -134,25 +235,32 @@ void DeterministicTimer::addDelay(struct timespec delayTicks)
      * otherwise it could easily build up and make us freeze (in some games)
      */
 
-    TimeHolder maxDeferredDelay = timeIncrement * 6;
-
-    addedDelay += delayTicks;
-    ticks += delayTicks;
-    forceAdvancedTicks += delayTicks;
+    bool tooMuchDelay;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        addedDelay += delayTicks;
+        ticks += delayTicks;
+        forceAdvancedTicks += delayTicks;
+        publishTicks();
+        tooMuchDelay = addedDelay > timeIncrement * 6;
+    }
 
-    if(!tasflags.fastforward)
+    if(!tasflags.fastforward && !tasflags.turbo)
     {
         /* Sleep, because the caller would have yielded at least a little */
         struct timespec nosleep = {0, 0};
         orig::nanosleep(&nosleep, NULL);
     }
 
-    while(addedDelay > maxDeferredDelay)
+    while(tooMuchDelay)
     {
         /* Indicating that the following frame boundary is not
          * a normal (draw) frame boundary.
          */
-        drawFB = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            drawFB = false;
+        }
 
         /* We have built up too much delay. We must enter a frame boundary,
          * to advance the time.
@@ -164,22 +272,24 @@ void DeterministicTimer::addDelay(struct timespec delayTicks)
 #else
         frameBoundary(false, [] () {});
 #endif
+
+        std::lock_guard<std::mutex> lock(mutex);
+        tooMuchDelay = addedDelay > timeIncrement * 6;
     }
 }
 
 void DeterministicTimer::exitFrameBoundary()
 {
-    //std::lock_guard<std::mutex> lock(mutex);
     DEBUGLOGCALL(LCF_TIMEGET | LCF_FRAME);
 
     /* Reset the counts of each time get function */
     for(int i = 0; i < TIMETYPE_NUMTRACKEDTYPES; i++)
-        altGetTimes[i] = 0;
+        altGetTimes[i].store(0, std::memory_order_relaxed);
 
     if(tasflags.framerate == 0)
         return nonDetTimer.exitFrameBoundary(); // 0 framerate means disable deterministic timer
 
-    getTimes = 0;
+    std::lock_guard<std::mutex> lock(mutex);
 
     if(addedDelay > timeIncrement)
         addedDelay -= timeIncrement;
@@ -192,14 +302,23 @@ void DeterministicTimer::exitFrameBoundary()
 
 void DeterministicTimer::enterFrameBoundary()
 {
-    //std::lock_guard<std::mutex> lock(mutex);
     DEBUGLOGCALL(LCF_TIMEGET | LCF_FRAME);
 
-    if(tasflags.framerate == 0)
-        return nonDetTimer.enterFrameBoundary(); // 0 framerate means disable deterministic timer
+    if(tasflags.framerate == 0) {
+        nonDetTimer.enterFrameBoundary(); // 0 framerate means disable deterministic timer
+        std::lock_guard<std::mutex> lock(mutex);
+        frameTicks = nonDetTimer.getTicks();
+        return;
+    }
 
     /*** First we update the state of the internal timer ***/
 
+    TimeHolder deltaTicks;
+    deltaTicks.tv_sec = 0;
+    deltaTicks.tv_nsec = 0;
+
+    std::unique_lock<std::mutex> lock(mutex);
+
     /* We compute by how much we should advance the timer
      * to run exactly as the indicated framerate
      */
@@ -233,64 +352,75 @@ void DeterministicTimer::enterFrameBoundary()
      * If not, we add the remaining ticks
      */
     if (timeIncrement > takenTicks) {
-        TimeHolder deltaTicks = timeIncrement - takenTicks;
+        deltaTicks = timeIncrement - takenTicks;
         ticks += deltaTicks;
-        debuglog(LCF_TIMESET | LCF_FRAME, __func__, " added ", deltaTicks.tv_sec * 1000000000 + deltaTicks.tv_nsec, " nsec");
+        publishTicks();
     }
 
-    /* Doing the audio mixing here */
-    audiocontext.mixAllSources(timeIncrement);
+    TimeHolder frameIncrement = timeIncrement;
+    frameTicks = readTicks();
+    lock.unlock();
 
-    /*** Then, we sleep the right amount of time so that the game runs at normal speed ***/
+    /* Non-main threads get a new budget to advance their clock */
+    frameIndex.fetch_add(1, std::memory_order_relaxed);
 
-    /* Get the current actual time */
-    TimeHolder currentTime;
-    orig::clock_gettime(CLOCK_MONOTONIC, &currentTime);
+    if (deltaTicks.tv_sec || deltaTicks.tv_nsec)
+        debuglog(LCF_TIMESET | LCF_FRAME, __func__, " added ", deltaTicks.tv_sec * 1000000000 + deltaTicks.tv_nsec, " nsec");
 
-    /* calculate the target time we wanted to be at now */
-    /* TODO: This is where we would implement slowdown */
-    TimeHolder desiredTime = lastEnterTime + timeIncrement;
+    /* Doing the audio mixing here */
+    audiocontext.mixAllSources(frameIncrement);
 
-    TimeHolder deltaTime = desiredTime - currentTime;
+    /*** Then, we sleep the right amount of time so that the game runs at normal speed ***/
+    pacer.waitNextFrame(frameIncrement);
 
-    /* If we are not fast forwarding, and not the first frame,
-     * then we wait the delta amount of time.
-     */
-    if (!tasflags.fastforward && lastEnterValid) {
+    lock.lock();
+    lastEnterTicks = ticks;
+}
 
-        /* Check that we wait for a positive time */
-        if ((deltaTime.tv_sec > 0) || ((deltaTime.tv_sec == 0) && (deltaTime.tv_nsec >= 0))) {
-            orig::nanosleep(&deltaTime, NULL);
+struct timespec DeterministicTimer::getFrameTicks(void)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return frameTicks;
+}
+
+void DeterministicTimer::takeStats(TimeCallStats& out)
+{
+    out = stats;
+
+    /* Take the statistics of all other threads, including the ones that
+     * did not query the time since the last frame boundary */
+    for (int t = 0; t <= TIMECALLSTATS_MAXTHREADS; t++) {
+        for (int i = 0; i < TIMETYPE_NUMTRACKEDTYPES; i++) {
+            uint32_t calls = threadCounts[t].calls[i].exchange(0, std::memory_order_relaxed);
+            out.otherCalls[i] += calls;
+            if (t < TIMECALLSTATS_MAXTHREADS)
+                out.threadCalls[t][i] = calls;
         }
+        uint32_t advances = threadCounts[t].advances.exchange(0, std::memory_order_relaxed);
+        out.threadAdvances += advances;
+        if (t < TIMECALLSTATS_MAXTHREADS)
+            out.threadClockAdvances[t] = advances;
     }
 
-    /* 
-     * WARNING: This time update is not done in Hourglass,
-     * maybe intentionally (the author does not remember).
-     */
-    orig::clock_gettime(CLOCK_MONOTONIC, &currentTime);
-
-    lastEnterTime = currentTime;
-
-    lastEnterTicks = ticks;
-    lastEnterValid = true;
+    stats = TimeCallStats();
 }
 
 void DeterministicTimer::fakeAdvanceTimer(struct timespec extraTicks) {
+    std::lock_guard<std::mutex> lock(mutex);
     fakeExtraTicks = extraTicks;
+    publishTicks();
 }
 
 void DeterministicTimer::initialize(void)
 {
-    getTimes = 0;
+    std::lock_guard<std::mutex> lock(mutex);
     ticks.tv_sec = 0;
     ticks.tv_nsec = 0;
     fractional_part = 0;
-    orig::clock_gettime(CLOCK_MONOTONIC, &lastEnterTime);
     lastEnterTicks = ticks;
 
     for(int i = 0; i < TIMETYPE_NUMTRACKEDTYPES; i++)
-        altGetTimes[i] = 0;
+        altGetTimes[i].store(0, std::memory_order_relaxed);
     for(int i = 0; i < TIMETYPE_NUMTRACKEDTYPES; i++)
         altGetTimeLimits[i] = 20;
 
@@ -298,9 +428,11 @@ void DeterministicTimer::initialize(void)
     addedDelay.tv_nsec = 0;
     forceAdvancedTicks = addedDelay;
     fakeExtraTicks = addedDelay;
-    lastEnterValid = false;
+    pacer.reset();
 
     drawFB = true;
+
+    publishTicks();
 }
 
 DeterministicTimer detTimer;
@@ -22,20 +22,10 @@
 
 #include <time.h>
 #include "TimeHolder.h"
+#include "FramePacer.h"
+#include "../shared/TimeCallStats.h"
 #include <mutex>
-
-/* An enum indicating which time-getting function query the time */
-enum TimeCallType
-{
-    TIMETYPE_UNTRACKED = -1,
-    TIMETYPE_TIME = 0,
-    TIMETYPE_GETTIMEOFDAY,
-    TIMETYPE_CLOCK,
-    TIMETYPE_CLOCKGETTIME,
-    TIMETYPE_SDLGETTICKS,
-    TIMETYPE_SDLGETPERFORMANCECOUNTER,
-    TIMETYPE_NUMTRACKEDTYPES
-};
+#include <atomic>
 
 /* A timer that gives deterministic values, at least in the main thread.
  *
@@ -44,11 +34,17 @@ enum TimeCallType
  * independently of anything else like the system clock or CPU speed.
  *
  * The main thread is defined as the thread that called SDL_Init(),
+ * other threads have their own clock that follows the main one, see
+ * getThreadTicks().
  *
  * The trick to making this timer deterministic and still run at a normal speed is:
  * we define a frame rate beforehand and always tell the game it is running that fast
  * from frame to frame. Then we do the waiting ourselves for each frame (using system timer).
  * this also lets us support "fast forward" without changing the values the game sees.
+ *
+ * The timer is read from every thread of the game, possibly millions of
+ * times per second, so reading never locks: the value is published using a
+ * seqlock. Updating the timer is done by the main thread under the mutex.
  */
 
 class DeterministicTimer
@@ -72,9 +68,17 @@ public:
     /* Function called when exiting a frame boundary */
     void exitFrameBoundary(void);
 
+    /* Time reached at the last frame boundary enter, up to which the
+     * emulated SDL timers must be run */
+    struct timespec getFrameTicks(void);
+
     /* Add a delay in the timer, and sleep */
 	void addDelay(struct timespec delayTicks);
 
+    /* Get the time query statistics since the last call, and reset them.
+     * Must be called by the main thread. */
+    void takeStats(TimeCallStats& out);
+
     /* In specific situations, we must fake advancing timer.
      * This function temporarily fake adding ticks to the timer.
      * To be used like this:
@@ -86,8 +90,9 @@ public:
 
 private:
 
-    /* Number of getTicks calls of a non main thread */
-    unsigned int getTimes;
+    /* Number of frame boundaries entered, used by non-main threads to
+     * reset their own clock budget */
+    std::atomic<unsigned long> frameIndex;
 
     /* By how much time did we increment the timer */
     TimeHolder timeIncrement;
@@ -95,28 +100,24 @@ private:
     /* Remainder when increasing the timer by 1/fps */
     unsigned int fractional_part;
 
-    /* State of the deterministic timer */
+    /* State of the deterministic timer. Only accessed with the mutex held,
+     * readers use the published value below */
     TimeHolder ticks;
 
     /* Timer value during the last frame boundary enter */
     TimeHolder lastEnterTicks;
 
+    /* Time up to which the emulated SDL timers must be run, see getFrameTicks() */
+    TimeHolder frameTicks;
+
     /*
      * Extra ticks to add to GetTicks().
      * Required for very specific situations.
      */
     TimeHolder fakeExtraTicks;
 
-    /* 
-     * Real time of the last frame boundary enter.
-     * Used for sleeping the right amount of time
-     */
-    TimeHolder lastEnterTime;
-
-    /* Is the lastEnterTime value valid?
-     * True except on the first frame
-     */
-    bool lastEnterValid;
+    /* Sleeping the right amount of time at each frame */
+    FramePacer pacer;
 
     /* Accumulated delay */
     TimeHolder addedDelay;
@@ -133,11 +134,32 @@ private:
     bool drawFB;
 
     /* Limit for each time-getting method before time auto-advances to avoid a freeze */
-    unsigned int altGetTimes [TIMETYPE_NUMTRACKEDTYPES];
+    std::atomic<unsigned int> altGetTimes [TIMETYPE_NUMTRACKEDTYPES];
     unsigned int altGetTimeLimits [TIMETYPE_NUMTRACKEDTYPES];
 
-    /* Mutex to protect access to all audio objects */
+    /* Mutex serializing the updates of the timer state */
     std::mutex mutex;
+
+    /* Sequence counter of the published value, odd while it is updated */
+    std::atomic<unsigned int> sequence;
+
+    /* Value returned by getTicks(), which is ticks + fakeExtraTicks */
+    std::atomic<time_t> publishedSec;
+    std::atomic<long> publishedNsec;
+
+    /* Publish the current timer value to readers. Must be called with
+     * the mutex held, after each modification of ticks or fakeExtraTicks */
+    void publishTicks(void);
+
+    /* Read the published timer value, without locking. Retries if the
+     * value was modified during the read, so it is never torn */
+    TimeHolder readTicks(void);
+
+    /* Return the time for a non-main thread, using its own clock */
+    TimeHolder getThreadTicks(TimeCallType type);
+
+    /* Time query statistics of the main thread, only modified by it */
+    TimeCallStats stats;
 };
 
 extern DeterministicTimer detTimer;
@@ -25,13 +25,11 @@
 
 EventQueue sdlEventQueue;
 
-EventQueue::~EventQueue()
+EventQueue::EventQueue()
 {
-    for (auto ev: eventQueue) {
-        if (SDLver == 1)
-            delete static_cast<SDL1::SDL_Event*>(ev);
-        if (SDLver == 2)
-            delete static_cast<SDL_Event*>(ev);
+    for (int b = 0; b < NUMBUCKETS; b++) {
+        buckets[b].first = NONE;
+        buckets[b].last = NONE;
     }
 }
 
@@ -39,30 +37,319 @@ void EventQueue::init(void)
 {
     if (SDLver == 2) {
         /* Insert default filters */
-        droppedEvents.insert(SDL_TEXTINPUT);
-        droppedEvents.insert(SDL_TEXTEDITING);
-        droppedEvents.insert(SDL_SYSWMEVENT);
+        disable(SDL_TEXTINPUT);
+        disable(SDL_TEXTEDITING);
+        disable(SDL_SYSWMEVENT);
     }
 }
 
 void EventQueue::disable(int type)
 {
-    droppedEvents.insert(type);
+    Uint32 t = type;
+    if (t < NUMTYPES)
+        droppedEvents[t >> 6] |= 1ULL << (t & 63);
 }
 
 void EventQueue::enable(int type)
 {
-    std::set<int>::iterator it = droppedEvents.find(type);
-    if (it != droppedEvents.end())
-        droppedEvents.erase(it);
+    Uint32 t = type;
+    if (t < NUMTYPES)
+        droppedEvents[t >> 6] &= ~(1ULL << (t & 63));
 }
 
 bool EventQueue::isEnabled(int type)
 {
-    return droppedEvents.find(type) == droppedEvents.end();
+    Uint32 t = type;
+    return (t >= NUMTYPES) || !(droppedEvents[t >> 6] & (1ULL << (t & 63)));
 }
 
-#define EVENTQUEUE_MAXLEN 1024
+static inline int typeIndex(Uint32 type, int numTypes)
+{
+    return (type < static_cast<Uint32>(numTypes)) ? type : (numTypes - 1);
+}
+
+static inline int bucketIndex(int typeIndex)
+{
+    return (typeIndex < 0x100) ? typeIndex : (typeIndex >> 8);
+}
+
+/* Is there a set bit between positions first and last of the bitmap? */
+static bool anyBit(const uint64_t* bits, int first, int last)
+{
+    if (first > last)
+        return false;
+
+    int firstWord = first >> 6;
+    int lastWord = last >> 6;
+    uint64_t firstMask = ~0ULL << (first & 63);
+    uint64_t lastMask = ~0ULL >> (63 - (last & 63));
+
+    if (firstWord == lastWord)
+        return bits[firstWord] & firstMask & lastMask;
+
+    if ((bits[firstWord] & firstMask) || (bits[lastWord] & lastMask))
+        return true;
+
+    for (int w = firstWord + 1; w < lastWord; w++)
+        if (bits[w])
+            return true;
+
+    return false;
+}
+
+/* Set the bits between positions first and last of the bitmap */
+static void setBits(uint64_t* bits, int first, int last)
+{
+    for (int w = first >> 6; w <= (last >> 6); w++) {
+        uint64_t mask = ~0ULL;
+        if (w == (first >> 6))
+            mask &= ~0ULL << (first & 63);
+        if (w == (last >> 6))
+            mask &= ~0ULL >> (63 - (last & 63));
+        bits[w] |= mask;
+    }
+}
+
+void EventQueue::rangeBuckets(uint64_t* candidates, Uint32 minType, Uint32 maxType)
+{
+    int first = typeIndex(minType, NUMTYPES);
+    int last = typeIndex(maxType, NUMTYPES);
+
+    /* The category is not increasing with the type: types below 0x100
+     * are their own category, larger ones use their high byte. So we
+     * take the union of the categories of both parts of the range.
+     */
+    for (int w = 0; w < NUMBUCKETS / 64; w++)
+        candidates[w] = 0;
+    if (first < 0x100)
+        setBits(candidates, first, (last < 0x100) ? last : 0xff);
+    if (last >= 0x100)
+        setBits(candidates, ((first < 0x100) ? 0x100 : first) >> 8, last >> 8);
+
+    for (int w = 0; w < NUMBUCKETS / 64; w++)
+        candidates[w] &= bucketBits[w];
+}
+
+bool EventQueue::hasTypes(Uint32 minType, Uint32 maxType)
+{
+    if ((count == 0) || (minType > maxType))
+        return false;
+
+    int first = typeIndex(minType, NUMTYPES);
+    int last = typeIndex(maxType, NUMTYPES);
+    if ((first == 0) && (last == NUMTYPES - 1))
+        return true;
+
+    /* Check the partial words at both ends, and use the summary
+     * bitmap for the full words in between */
+    int firstWord = first >> 6;
+    int lastWord = last >> 6;
+    if (firstWord == lastWord)
+        return anyBit(typeBits, first, last);
+    if (anyBit(typeBits, first, (firstWord << 6) + 63) || anyBit(typeBits, lastWord << 6, last))
+        return true;
+    return anyBit(typeWords, firstWord + 1, lastWord - 1);
+}
+
+bool EventQueue::onlyTypes(Uint32 minType, Uint32 maxType)
+{
+    return ((minType == 0) || !hasTypes(0, minType - 1)) &&
+           ((maxType >= NUMTYPES - 1) || !hasTypes(maxType + 1, NUMTYPES - 1));
+}
+
+void EventQueue::link(int slot)
+{
+    int t = typeIndex(links[slot].type, NUMTYPES);
+    int b = bucketIndex(t);
+
+    links[slot].prev = buckets[b].last;
+    links[slot].next = NONE;
+    if (buckets[b].last == NONE)
+        buckets[b].first = slot;
+    else
+        links[buckets[b].last].next = slot;
+    buckets[b].last = slot;
+    bucketBits[b >> 6] |= 1ULL << (b & 63);
+}
+
+void EventQueue::remove(int slot)
+{
+    SlotLink& l = links[slot];
+    int t = typeIndex(l.type, NUMTYPES);
+    int b = bucketIndex(t);
+
+    if (l.prev == NONE)
+        buckets[b].first = l.next;
+    else
+        links[l.prev].next = l.next;
+    if (l.next == NONE)
+        buckets[b].last = l.prev;
+    else
+        links[l.next].prev = l.prev;
+    if (buckets[b].first == NONE)
+        bucketBits[b >> 6] &= ~(1ULL << (b & 63));
+
+    if (--typeCount[t] == 0) {
+        typeBits[t >> 6] &= ~(1ULL << (t & 63));
+        if (!typeBits[t >> 6])
+            typeWords[t >> 12] &= ~(1ULL << ((t >> 6) & 63));
+    }
+
+    l.used = false;
+    count--;
+}
+
+void EventQueue::advanceHead()
+{
+    while ((span > 0) && !links[head].used) {
+        head = (head + 1) & RINGMASK;
+        span--;
+    }
+}
+
+void EventQueue::compact()
+{
+    int kept = 0;
+    for (int i = 0; i < span; i++) {
+        int src = (head + i) & RINGMASK;
+        if (!links[src].used)
+            continue;
+
+        int dst = (head + kept++) & RINGMASK;
+        if (src != dst) {
+            memcpy(&eventQueue[dst], &eventQueue[src], sizeof(EventSlot));
+            links[dst].type = links[src].type;
+            links[dst].used = true;
+            links[src].used = false;
+        }
+    }
+    span = kept;
+
+    for (int b = 0; b < NUMBUCKETS; b++) {
+        buckets[b].first = NONE;
+        buckets[b].last = NONE;
+    }
+    for (int i = 0; i < span; i++)
+        link((head + i) & RINGMASK);
+}
+
+template<typename Event>
+void EventQueue::push(const Event* event)
+{
+    if (count == MAXLEN) {
+        debuglog(LCF_SDL | LCF_EVENTS | LCF_ERROR, "We reached the limit of the event queue size!");
+        return;
+    }
+
+    /* The ring can only be full of holes here */
+    if (span == RINGSIZE)
+        compact();
+
+    /* Push the event at the end of the queue */
+    int slot = (head + span) & RINGMASK;
+    memcpy(&eventQueue[slot], event, sizeof(Event));
+    span++;
+    count++;
+
+    links[slot].type = event->type;
+    links[slot].used = true;
+    link(slot);
+
+    int t = typeIndex(event->type, NUMTYPES);
+    if (typeCount[t]++ == 0) {
+        typeBits[t >> 6] |= 1ULL << (t & 63);
+        typeWords[t >> 12] |= 1ULL << ((t >> 6) & 63);
+    }
+}
+
+int EventQueue::nextInRange(int slot, Uint32 minType, Uint32 maxType)
+{
+    while ((slot != NONE) && ((links[slot].type < minType) || (links[slot].type > maxType)))
+        slot = links[slot].next;
+    return slot;
+}
+
+template<typename Event>
+int EventQueue::extractInOrder(Event* events, int num, Uint32 minType, Uint32 maxType, bool update)
+{
+    int evi = 0;
+    for (int i = 0; (i < span) && (evi < num); i++) {
+        int slot = (head + i) & RINGMASK;
+        if (!links[slot].used || (links[slot].type < minType) || (links[slot].type > maxType))
+            continue;
+
+        memcpy(&events[evi++], &eventQueue[slot], sizeof(Event));
+        if (update)
+            remove(slot);
+    }
+
+    if (update)
+        advanceHead();
+    return evi;
+}
+
+template<typename Event>
+int EventQueue::extractFromBuckets(Event* events, int num, const uint64_t* candidates, Uint32 minType, Uint32 maxType, bool update)
+{
+    /* Get the first matching event of each category */
+    int cursors[NUMBUCKETS];
+    int numCursors = 0;
+    for (int w = 0; w < NUMBUCKETS / 64; w++) {
+        for (uint64_t bits = candidates[w]; bits; bits &= bits - 1) {
+            int b = (w << 6) + __builtin_ctzll(bits);
+            int slot = nextInRange(buckets[b].first, minType, maxType);
+            if (slot != NONE)
+                cursors[numCursors++] = slot;
+        }
+    }
+
+    /* Merge the lists by taking the oldest event each time */
+    int evi = 0;
+    while ((evi < num) && (numCursors > 0)) {
+        int best = 0;
+        int bestAge = (cursors[0] - head) & RINGMASK;
+        for (int c = 1; c < numCursors; c++) {
+            int age = (cursors[c] - head) & RINGMASK;
+            if (age < bestAge) {
+                best = c;
+                bestAge = age;
+            }
+        }
+
+        int slot = cursors[best];
+        memcpy(&events[evi++], &eventQueue[slot], sizeof(Event));
+
+        int next = nextInRange(links[slot].next, minType, maxType);
+        if (next == NONE)
+            cursors[best] = cursors[--numCursors];
+        else
+            cursors[best] = next;
+
+        if (update)
+            remove(slot);
+    }
+
+    if (update)
+        advanceHead();
+    return evi;
+}
+
+void EventQueue::removeFromBuckets(const uint64_t* candidates, Uint32 minType, Uint32 maxType)
+{
+    for (int w = 0; w < NUMBUCKETS / 64; w++) {
+        for (uint64_t bits = candidates[w]; bits; bits &= bits - 1) {
+            int b = (w << 6) + __builtin_ctzll(bits);
+            int slot = nextInRange(buckets[b].first, minType, maxType);
+            while (slot != NONE) {
+                int next = nextInRange(links[slot].next, minType, maxType);
+                remove(slot);
+                slot = next;
+            }
+        }
+    }
+
+    advanceHead();
+}
 
 void EventQueue::insert(SDL_Event* event)
 {
@@ -84,19 +371,8 @@ void EventQueue::insert(SDL_Event* event)
         watch.first(watch.second, event);
     }
 
-    /* 4. Check the size of the queue */    
-    if (eventQueue.size() > 1024)
-        debuglog(LCF_SDL | LCF_EVENTS, "We reached the limit of the event queue size!");
-
-    /* Building a dynamically allocated event */
-    /* TODO: Hmmm... creating and destroying objects that many times
-     * does not seem like a good pattern...
-     */
-    SDL_Event* ev = new SDL_Event;
-    memcpy(ev, event, sizeof(SDL_Event));
-
-    /* Push the event at the end of the queue */
-    eventQueue.push_back(ev);
+    /* 4. Copy the event in the queue if there is room left */
+    push(event);
 }
 
 void EventQueue::insert(SDL1::SDL_Event* event)
@@ -114,150 +390,84 @@ void EventQueue::insert(SDL1::SDL_Event* event)
             return;
     }
 
-    if (eventQueue.size() > 1024)
-        debuglog(LCF_SDL | LCF_EVENTS, "We reached the limit of the event queue size!");
+    /* 3. Copy the event in the queue if there is room left */
+    push(event);
+}
 
-    /* Building a dynamically allocated event */
-    SDL1::SDL_Event* ev = new SDL1::SDL_Event;
-    memcpy(ev, event, sizeof(SDL1::SDL_Event));
+void EventQueue::insert(SDL_Event* events, int num)
+{
+    for (int i = 0; i < num; i++)
+        insert(&events[i]);
+}
 
-    /* Push the event at the end of the queue */
-    eventQueue.push_back(ev);
+void EventQueue::insert(SDL1::SDL_Event* events, int num)
+{
+    for (int i = 0; i < num; i++)
+        insert(&events[i]);
 }
 
 int EventQueue::pop(SDL_Event* events, int num, Uint32 minType, Uint32 maxType, bool update)
 {
-    int evi = 0;
-
-    if (num <= 0)
+    if ((num <= 0) || !hasTypes(minType, maxType))
         return 0;
 
-    std::list<void*>::iterator it = eventQueue.begin();
-    while (it != eventQueue.end()) {
-        SDL_Event* ev = static_cast<SDL_Event*>(*it);
-
-        /* Check if event match the filter */
-        if ((ev->type >= minType) && (ev->type <= maxType)) {
-    
-            /* Copy the event in the array */
-            memcpy(&events[evi], ev, sizeof(SDL_Event));
-            evi++;
-
-            if (update) {
-                /* Deleting the object and removing it from the list */
-                delete ev;
-                it = eventQueue.erase(it);
-            }
-            else
-                ++it;
+    /* Walk the ring directly when all events match, like SDL_PollEvent() */
+    if (onlyTypes(minType, maxType))
+        return extractInOrder(events, num, minType, maxType, update);
 
-            /* Check if we reached the limit on the number of events */
-            if (evi >= num)
-                return num;
-        }
-        else {
-            ++it;
-        }
-
-    }
-
-    return evi;
+    uint64_t candidates[NUMBUCKETS / 64];
+    rangeBuckets(candidates, minType, maxType);
 
+    return extractFromBuckets(events, num, candidates, minType, maxType, update);
 }
 
 int EventQueue::pop(SDL1::SDL_Event* events, int num, Uint32 mask, bool update)
 {
-    int evi = 0;
-
-    if (num <= 0)
+    /* SDL 1.2 event types are below 32, and each one is its own category */
+    if ((num <= 0) || (count == 0) || !(typeBits[0] & mask))
         return 0;
 
-    std::list<void*>::iterator it = eventQueue.begin();
-    while (it != eventQueue.end()) {
-        SDL1::SDL_Event* ev = static_cast<SDL1::SDL_Event*>(*it);
-
-        /* Check if event match the filter */
-        if (mask & SDL_EVENTMASK(ev->type)) {
-    
-            /* Copy the event in the array */
-            memcpy(&events[evi], ev, sizeof(SDL1::SDL_Event));
-            evi++;
-
-            if (update) {
-                /* Deleting the object and removing it from the list */
-                delete ev;
-                it = eventQueue.erase(it);
-            }
-            else
-                ++it;
-
-            /* Check if we reached the limit on the number of events */
-            if (evi >= num)
-                return num;
-
-        }
-        else {
-            ++it;
-        }
-    }
-
-    return evi;
+    if (!(typeBits[0] & ~static_cast<uint64_t>(mask)) && !hasTypes(64, NUMTYPES - 1))
+        return extractInOrder(events, num, 0, 0xffffffff, update);
 
+    uint64_t candidates[NUMBUCKETS / 64] = {mask & bucketBits[0]};
+    return extractFromBuckets(events, num, candidates, 0, 0xffffffff, update);
 }
 
 void EventQueue::flush(Uint32 minType, Uint32 maxType)
 {
-    std::list<void*>::iterator it = eventQueue.begin();
-    while (it != eventQueue.end()) {
-        SDL_Event* ev = static_cast<SDL_Event*>(*it);
+    if (!hasTypes(minType, maxType))
+        return;
 
-        /* Check if event match the filter */
-        if ((ev->type >= minType) && (ev->type <= maxType)) {
-            /* Deleting the object and removing it from the list */
-            delete ev;
-            it = eventQueue.erase(it);
-        }
-        else {
-            ++it;
-        }
-    }
+    uint64_t candidates[NUMBUCKETS / 64];
+    rangeBuckets(candidates, minType, maxType);
+
+    removeFromBuckets(candidates, minType, maxType);
 }
 
 void EventQueue::flush(Uint32 mask)
 {
-    std::list<void*>::iterator it = eventQueue.begin();
-    while (it != eventQueue.end()) {
-        SDL1::SDL_Event* ev = static_cast<SDL1::SDL_Event*>(*it);
+    if ((count == 0) || !(typeBits[0] & mask))
+        return;
 
-        /* Check if event match the filter */
-        if (mask & SDL_EVENTMASK(ev->type)) {
-            /* Deleting the object and removing it from the list */
-            delete ev;
-            it = eventQueue.erase(it);
-        }
-        else {
-            ++it;
-        }
-    }
+    uint64_t candidates[NUMBUCKETS / 64] = {mask & bucketBits[0]};
+    removeFromBuckets(candidates, 0, 0xffffffff);
 }
 
 void EventQueue::applyFilter(SDL_EventFilter filter, void* userdata)
 {
-    std::list<void*>::iterator it = eventQueue.begin();
-    while (it != eventQueue.end()) {
-        SDL_Event* ev = static_cast<SDL_Event*>(*it);
-
-        /* Run the filter function and check the result */
-        int isKept = filter(userdata, ev);
-        if (!isKept) {
-            /* Deleting the object and removing it from the list */
-            delete ev;
-            it = eventQueue.erase(it);
-        }
-        else {
-            ++it;
-        }
+    for (int i = 0; i < span; i++) {
+        int slot = (head + i) & RINGMASK;
+        if (!links[slot].used)
+            continue;
+
+        /* Run the filter function and remove the event if it returns 0 */
+        int isKept = filter(userdata, &eventQueue[slot].ev2);
+        if (!isKept)
+            remove(slot);
     }
+
+    advanceHead();
 }
 
 void EventQueue::setFilter(SDL_EventFilter filter, void* userdata)
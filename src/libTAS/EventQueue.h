@@ -20,15 +20,18 @@
 #ifndef LIBTAS_EVENTQUEUE_H_INCLUDED
 #define LIBTAS_EVENTQUEUE_H_INCLUDED
 
-#include <list>
 #include <set>
+#include <stdint.h>
 #include "../external/SDL.h"
 #include "sdlevents.h" // SDL_EventFilter
 
 class EventQueue
 {
     public:
-        ~EventQueue();
+        /* Maximum number of events in the queue, same as SDL */
+        static const int MAXLEN = 65535;
+
+        EventQueue();
 
         void init();
 
@@ -36,6 +39,10 @@ class EventQueue
         void insert(SDL1::SDL_Event* event);
         void insert(SDL_Event* event);
 
+        /* Same for an array of events, which are inserted in order */
+        void insert(SDL1::SDL_Event* events, int num);
+        void insert(SDL_Event* events, int num);
+
         /* Return a number of events from the queue.
          * @param events [OUT]  array of events to write to
          * @param num     [IN]  number of events to return
@@ -83,8 +90,108 @@ class EventQueue
         void delWatch(SDL_EventFilter filter, void* userdata);
 
     private:
-        std::list<void*> eventQueue;
-        std::set<int> droppedEvents;
+        /* The ring has one more slot than the maximum number of events,
+         * so that its indices can be wrapped with a mask.
+         */
+        static const int RINGSIZE = MAXLEN + 1;
+        static const int RINGMASK = RINGSIZE - 1;
+        static const int NONE = -1;
+
+        /* Events are also grouped by category, which is the high byte of
+         * the type for SDL 2 (keyboard, mouse, joystick...) or the type
+         * itself for SDL 1.2.
+         */
+        static const int NUMBUCKETS = 256;
+
+        /* Number of tracked event types. Larger types share the last one. */
+        static const int NUMTYPES = 0x10000;
+
+        /* Events are stored inline in a ring buffer, in the order of insertion.
+         * SDL 1.2 events are smaller and use the beginning of each slot.
+         * Removed events leave a hole until the head of the ring moves past them.
+         */
+        union EventSlot {
+            SDL_Event ev2;
+            SDL1::SDL_Event ev1;
+        };
+        EventSlot eventQueue[RINGSIZE];
+
+        /* Links of each slot inside the list of its category, which is
+         * ordered by insertion. */
+        struct SlotLink {
+            int prev;
+            int next;
+            Uint32 type;
+            bool used;
+        };
+        SlotLink links[RINGSIZE];
+
+        struct Bucket {
+            int first;
+            int last;
+        };
+        Bucket buckets[NUMBUCKETS];
+        uint64_t bucketBits[NUMBUCKETS / 64];
+
+        /* Number of queued events of each type, with a bitmap of the types
+         * that are present and a summary bitmap of its non-zero words,
+         * so that a type range can be checked in constant time.
+         */
+        uint16_t typeCount[NUMTYPES];
+        uint64_t typeBits[NUMTYPES / 64];
+        uint64_t typeWords[NUMTYPES / 64 / 64];
+
+        /* Slot of the oldest event, number of slots up to the newest event
+         * including holes, and number of events */
+        int head = 0;
+        int span = 0;
+        int count = 0;
+
+        /* Is there an event with a type inside the range? */
+        bool hasTypes(Uint32 minType, Uint32 maxType);
+
+        /* Are all events inside the type range? */
+        bool onlyTypes(Uint32 minType, Uint32 maxType);
+
+        /* Fill the bitmap of the non-empty categories that can hold
+         * events of the type range */
+        void rangeBuckets(uint64_t* candidates, Uint32 minType, Uint32 maxType);
+
+        /* Append a copy of the event at the end of the ring */
+        template<typename Event>
+        void push(const Event* event);
+
+        /* Add the slot at the end of the list of its category */
+        void link(int slot);
+
+        /* Remove the event of a slot */
+        void remove(int slot);
+
+        /* Move the head past the removed events */
+        void advanceHead();
+
+        /* Move all events at the beginning of the ring and rebuild the lists */
+        void compact();
+
+        /* Return the first slot from the list position with a type inside the range */
+        int nextInRange(int slot, Uint32 minType, Uint32 maxType);
+
+        /* Copy and optionally remove up to num events inside the type range,
+         * by walking the whole ring. Used when most events match. */
+        template<typename Event>
+        int extractInOrder(Event* events, int num, Uint32 minType, Uint32 maxType, bool update);
+
+        /* Same, but by merging the lists of the categories in the candidates bitmap */
+        template<typename Event>
+        int extractFromBuckets(Event* events, int num, const uint64_t* candidates, Uint32 minType, Uint32 maxType, bool update);
+
+        /* Remove all events inside the type range from the categories in the candidates bitmap */
+        void removeFromBuckets(const uint64_t* candidates, Uint32 minType, Uint32 maxType);
+
+        /* Bitmap of the event types that are not inserted. Larger types
+         * cannot be disabled. */
+        uint64_t droppedEvents[NUMTYPES / 64];
+
         std::set<std::pair<SDL_EventFilter,void*>> watches;
         SDL1::SDL_EventFilter filterFunc1 = nullptr;
         SDL_EventFilter filterFunc = nullptr;
@@ -94,4 +201,3 @@ class EventQueue
 extern EventQueue sdlEventQueue;
 
 #endif
-
@@ -0,0 +1,120 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FramePacer.h"
+#include "logging.h"
+#include "../shared/tasflags.h"
+#include "time.h" // orig::clock_gettime
+#include "sleep.h" // orig::clock_nanosleep
+#include <errno.h>
+
+/* Bounds of the spin margin, in nsec */
+#define MIN_SPIN_MARGIN 20000
+#define MAX_SPIN_MARGIN 2000000
+
+/* Number of paced frames between two statistics reports */
+#define PACING_REPORT_FRAMES 300
+
+static long long toNsec(const TimeHolder& th)
+{
+    return th.tv_sec * 1000000000LL + th.tv_nsec;
+}
+
+void FramePacer::reset(void)
+{
+    frameTimeValid = false;
+}
+
+void FramePacer::waitNextFrame(TimeHolder frameDuration)
+{
+    TimeHolder currentTime;
+    orig::clock_gettime(CLOCK_MONOTONIC, &currentTime);
+
+    /* When fast-forwarding or on the first frame, there is nothing to wait
+     * for. Restart the frame times from now. */
+    if (tasflags.fastforward || tasflags.turbo || !frameTimeValid) {
+        frameTime = currentTime;
+        frameTimeValid = true;
+        return;
+    }
+
+    int divisor = (tasflags.speed_divisor > 1) ? tasflags.speed_divisor : 1;
+    TimeHolder realDuration = frameDuration * divisor;
+    TimeHolder targetTime = frameTime + realDuration;
+
+    /* If we are late by more than a frame (e.g. the game was paused),
+     * do not try to catch up, which would run many frames at full speed. */
+    if (currentTime > (targetTime + realDuration)) {
+        frameTime = currentTime;
+        return;
+    }
+
+    if (targetTime > currentTime) {
+        /* Sleep until a bit before the frame time */
+        TimeHolder margin;
+        margin.tv_sec = 0;
+        margin.tv_nsec = spinMargin;
+        TimeHolder wakeTime = targetTime - margin;
+
+        if (wakeTime > currentTime) {
+            while (orig::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeTime, NULL) == EINTR) {}
+            orig::clock_gettime(CLOCK_MONOTONIC, &currentTime);
+
+            /* Adapt the spin margin to how late we were woken up */
+            long long overSleep = toNsec(currentTime - wakeTime);
+            if (overSleep > spinMargin)
+                spinMargin = (overSleep * 2 < MAX_SPIN_MARGIN) ? overSleep * 2 : MAX_SPIN_MARGIN;
+            else if (spinMargin > MIN_SPIN_MARGIN)
+                spinMargin -= spinMargin / 16;
+        }
+
+        /* Spin until the frame time */
+        while (targetTime > currentTime)
+            orig::clock_gettime(CLOCK_MONOTONIC, &currentTime);
+    }
+
+    addError(toNsec(currentTime - targetTime));
+
+    /* The next frame time is based on this frame time, and not on the
+     * actual time, so that the pace does not drift. */
+    frameTime = targetTime;
+}
+
+void FramePacer::addError(long long error)
+{
+    statFrames++;
+    statErrorSum += error;
+    if (error > statErrorMax)
+        statErrorMax = error;
+    if (error > 1000000)
+        statLateFrames++;
+
+    if (statFrames < PACING_REPORT_FRAMES)
+        return;
+
+    debuglog(LCF_TIMESET | LCF_FRAME, "Pacing error over ", statFrames, " frames: mean ",
+        statErrorSum / statFrames / 1000, " us, max ", statErrorMax / 1000,
+        " us, ", statLateFrames, " frames late by more than 1 ms, spin margin ",
+        spinMargin / 1000, " us");
+
+    statFrames = 0;
+    statLateFrames = 0;
+    statErrorSum = 0;
+    statErrorMax = 0;
+}
@@ -0,0 +1,64 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_FRAMEPACER_H_INCL
+#define LIBTAS_FRAMEPACER_H_INCL
+
+#include "TimeHolder.h"
+
+/* Make the game run at the speed given by its framerate and the speed
+ * divisor, by waiting at each frame boundary until the real time of the
+ * frame is reached.
+ *
+ * Frame times are absolute, each one being the previous one plus the frame
+ * duration, so that errors do not accumulate. We sleep until a bit before
+ * the frame time, then spin until it is reached. The spin margin adapts to
+ * how late the system wakes us up.
+ */
+class FramePacer
+{
+public:
+    /* Forget the previous frame time, the next frame does not wait */
+    void reset(void);
+
+    /* Wait until the real time of the next frame. The frame lasts
+     * frameDuration of game time, multiplied by the speed divisor. */
+    void waitNextFrame(TimeHolder frameDuration);
+
+private:
+    /* Real time (CLOCK_MONOTONIC) of the last frame */
+    TimeHolder frameTime;
+
+    /* Is the frameTime value valid? */
+    bool frameTimeValid = false;
+
+    /* How long before the frame time we stop sleeping and start spinning, in nsec */
+    long spinMargin = 200000;
+
+    /* Pacing error statistics since the last report */
+    int statFrames = 0;
+    int statLateFrames = 0;
+    long long statErrorSum = 0;
+    long long statErrorMax = 0;
+
+    /* Add the pacing error of a frame, and log the statistics once in a while */
+    void addError(long long error);
+};
+
+#endif
@@ -20,6 +20,7 @@
 #include "../logging.h"
 #include "AudioContext.h"
 #include "AudioPlayer.h"
+#include "../../shared/tasflags.h"
 
 #define MAXBUFFERS 2048 // Max I've seen so far: 960
 #define MAXSOURCES 256 // Max I've seen so far: 112
@@ -174,6 +175,16 @@ void AudioContext::mixAllSources(struct timespec ticks)
         return;
     }
 
+    /* In turbo mode, the sound is not played, so we only need to mix
+     * if we are dumping. Sources must still advance, the game can query
+     * their position. */
+    if (tasflags.turbo && !tasflags.av_dumping) {
+        for (auto& source : sources) {
+            source->mixWith(ticks, nullptr, 0, outBitDepth, outNbChannels, outFrequency, outVolume, false);
+        }
+        return;
+    }
+
     outBytes = ticksToBytes(ticks, outAlignSize, outFrequency);
 	/* Save the actual number of samples and size */
 	outNbSamples = outBytes / outAlignSize;
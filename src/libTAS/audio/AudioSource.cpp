@@ -122,7 +122,7 @@ void AudioSource::setPosition(int pos)
     }
 }
 
-int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outBytes, int outBitDepth, int outNbChannels, int outFrequency, float outVolume)
+int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outBytes, int outBitDepth, int outNbChannels, int outFrequency, float outVolume, bool mix)
 {
     if (state != SOURCE_PLAYING)
         return -1;
@@ -166,7 +166,7 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
     /* Check if SWR context is initialized.
      * If not, set parameters and init it
      */
-    if (! swr_is_initialized(swr)) {
+    if (mix && ! swr_is_initialized(swr)) {
         /* Set channel layout */
         if (curBuf->nbChannels == 1)
             av_opt_set_int(swr, "in_channel_layout", AV_CH_LAYOUT_MONO, 0);
@@ -213,7 +213,8 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
     /* Allocate the mixed audio array */
 #if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
     int outNbSamples = outBytes / (outNbChannels * outBitDepth / 8);
-    mixedSamples.resize(outBytes);
+    if (mix)
+        mixedSamples.resize(outBytes);
     uint8_t* begMixed = mixedSamples.data();
 #endif
 
@@ -227,14 +228,15 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
         position = newPosition;
         debuglog(LCF_SOUND | LCF_FRAME, "  Buffer ", curBuf->id, " in read in range ", oldPosition, " - ", position);
 #if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-        convOutSamples = swr_convert(swr, &begMixed, outNbSamples, const_cast<const uint8_t**>(&begSamples), inNbSamples);
+        if (mix)
+            convOutSamples = swr_convert(swr, &begMixed, outNbSamples, const_cast<const uint8_t**>(&begSamples), inNbSamples);
 #endif
     }
     else {
         /* We reached the end of the buffer */
         debuglog(LCF_SOUND | LCF_FRAME, "  Buffer ", curBuf->id, " is read from ", oldPosition, " to its end ", curBuf->sampleSize);
 #if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-        if (availableSamples > 0)
+        if (mix && (availableSamples > 0))
             swr_convert(swr, nullptr, 0, const_cast<const uint8_t**>(&begSamples), availableSamples);
 #endif
 
@@ -254,6 +256,7 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
                 detTimer.fakeAdvanceTimer({0, 0});
                 availableSamples = curBuf->getSamples(begSamples, remainingSamples, 0);
 #if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
+                if (mix)
                     swr_convert(swr, nullptr, 0, const_cast<const uint8_t**>(&begSamples), availableSamples);
 #endif
                 debuglog(LCF_SOUND | LCF_FRAME, "  Buffer ", curBuf->id, " is read again from 0 to ", availableSamples);
@@ -264,7 +267,8 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
 
 #if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
             /* Get the mixed samples */
-            convOutSamples = swr_convert(swr, &begMixed, outNbSamples, nullptr, 0);
+            if (mix)
+                convOutSamples = swr_convert(swr, &begMixed, outNbSamples, nullptr, 0);
 #endif
         }
         else {
@@ -279,7 +283,8 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
                     availableSamples = loopbuf->getSamples(begSamples, remainingSamples, 0);
                     debuglog(LCF_SOUND | LCF_FRAME, "  Buffer ", loopbuf->id, " in read in range 0 - ", availableSamples);
 #if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-                    swr_convert(swr, nullptr, 0, const_cast<const uint8_t**>(&begSamples), availableSamples);
+                    if (mix)
+                        swr_convert(swr, nullptr, 0, const_cast<const uint8_t**>(&begSamples), availableSamples);
 #endif
                     if (remainingSamples == availableSamples) {
                         finalIndex = i;
@@ -294,7 +299,8 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
                     availableSamples = loopbuf->getSamples(begSamples, remainingSamples, 0);
                     debuglog(LCF_SOUND | LCF_FRAME, "  Buffer ", loopbuf->id, " in read in range 0 - ", availableSamples);
 #if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
-                    swr_convert(swr, nullptr, 0, const_cast<const uint8_t**>(&begSamples), availableSamples);
+                    if (mix)
+                        swr_convert(swr, nullptr, 0, const_cast<const uint8_t**>(&begSamples), availableSamples);
 #endif
                     if (remainingSamples == availableSamples) {
                         finalIndex = i;
@@ -306,7 +312,8 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
 
 #if defined(LIBTAS_ENABLE_AVDUMPING) || defined(LIBTAS_ENABLE_SOUNDPLAYBACK)
             /* Get the mixed samples */
-            convOutSamples = swr_convert(swr, &begMixed, outNbSamples, nullptr, 0);
+            if (mix)
+                convOutSamples = swr_convert(swr, &begMixed, outNbSamples, nullptr, 0);
 #endif
 
             if (remainingSamples > 0) {
@@ -329,7 +336,7 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
 #define clamptofullsignedrange(x,lo,hi) ((static_cast<unsigned int>((x)-(lo))<=static_cast<unsigned int>((hi)-(lo)))?(x):(((x)<0)?(lo):(hi)))
 
     /* Add mixed source to the output buffer */
-    if (outBitDepth == 8) {
+    if (mix && (outBitDepth == 8)) {
         for (int s=0; s<convOutSamples*outNbChannels; s+=outNbChannels) {
             int myL = mixedSamples[s];
             int otherL = outSamples[s];
@@ -345,7 +352,7 @@ int AudioSource::mixWith( struct timespec ticks, uint8_t* outSamples, int outByt
         }
     }
 
-    if (outBitDepth == 16) {
+    if (mix && (outBitDepth == 16)) {
         for (int s=0; s<convOutSamples*outNbChannels; s+=outNbChannels) {
             int myL = reinterpret_cast<int16_t*>(mixedSamples.data())[s];
             int otherL = reinterpret_cast<int16_t*>(outSamples)[s];
@@ -151,8 +151,11 @@ class AudioSource
         /* Mix the buffer with an external buffer of the given format.
          * The number of samples to mix correspond to the number of ticks given.
          * The function returns the number of samples written in the output buffer.
+         *
+         * If mix is false, only the position in the buffers is advanced
+         * (and callbacks are called), nothing is written.
          */
-        int mixWith( struct timespec ticks, uint8_t* outSamples, int outBytes, int outBitDepth, int outNbChannels, int outFrequency, float outVolume);
+        int mixWith( struct timespec ticks, uint8_t* outSamples, int outBytes, int outBitDepth, int outNbChannels, int outFrequency, float outVolume, bool mix = true);
 };
 
 #endif
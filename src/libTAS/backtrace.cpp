@@ -23,6 +23,7 @@
 #include <execinfo.h>
 #include <memory>
 #include <cstdio>
+#include <cstdlib>
 
 /* Code taken from http://stackoverflow.com/a/19190421 */
 static const char* demangle( const char* const symbol )
@@ -22,6 +22,9 @@
 #include "../shared/AllInputs.h"
 #include "../shared/messages.h"
 #include "../shared/Config.h"
+#include "../shared/FrameTimings.h"
+#include "../shared/TimeCallStats.h"
+#include "../shared/MemoryStats.h"
 #include "inputs/inputs.h" // AllInputs ai object
 #include "inputs/sdlinputevents.h"
 #include "socket.h"
@@ -30,8 +33,12 @@
 #include "avdumping.h"
 #include "EventQueue.h"
 #include "sdlwindows.h"
+#include "memory/MemoryManager.h"
+#include "memory/AllocTrace.h"
+#include "timer.h" // fireSDLTimers
 #include <mutex>
 #include <iomanip>
+#include <deque>
 
 /* Compute real and logical fps */
 static bool computeFPS(bool drawFB, float& fps, float& lfps)
@@ -76,6 +83,10 @@ static bool computeFPS(bool drawFB, float& fps, float& lfps)
 /* Deciding if we actually draw the frame */
 static bool skipDraw(void)
 {
+    /* In turbo mode, nothing is presented, except when dumping */
+    if (tasflags.turbo && !tasflags.av_dumping)
+        return true;
+
     static int skipCounter = 0;
     if (tasflags.fastforward) {
         if (skipCounter++ > 10)
@@ -87,6 +98,124 @@ static bool skipDraw(void)
     return skipCounter;
 }
 
+#ifdef LIBTAS_ENABLE_FRAME_PROFILING
+/* Timings of the current frame boundary, and of the previous one which
+ * is sent to linTAS during the current frame boundary */
+static FrameTimings frameTimings;
+static FrameTimings lastFrameTimings;
+
+/* Add the time spent in a scope to one of the phases of frameTimings */
+class PhaseTimer {
+    public:
+        PhaseTimer(uint64_t& p) : phase(p), start(now()) {}
+        ~PhaseTimer() {phase += now() - start;}
+
+        static uint64_t now(void)
+        {
+            struct timespec ts;
+            orig::clock_gettime(CLOCK_MONOTONIC, &ts);
+            return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+        }
+
+    private:
+        uint64_t& phase;
+        uint64_t start;
+};
+
+#define PROFILE_PHASE(phase) PhaseTimer phaseTimer_##phase(frameTimings.phase)
+#else
+#define PROFILE_PHASE(phase)
+#endif
+
+/* Inputs of a future frame, sent ahead of time by linTAS during playback */
+struct PrefetchedInputs {
+    unsigned long frame;
+    AllInputs inputs;
+};
+
+static std::deque<PrefetchedInputs> prefetchedInputs;
+
+/* Process a single message received from linTAS.
+ * Returns false if the message ends the frame boundary */
+static bool proceed_message(int message)
+{
+    PrefetchedInputs pi;
+
+    switch (message)
+    {
+        case MSGN_TASFLAGS:
+            receiveData(&tasflags, sizeof(struct TasFlags));
+            break;
+
+        case MSGN_END_FRAMEBOUNDARY:
+            return false;
+
+        case -1:
+            /* Connection is broken, there is nothing to wait for */
+            return false;
+
+        case MSGN_ALL_INPUTS:
+            receiveData(&ai, sizeof(struct AllInputs));
+            break;
+
+        case MSGN_PREFETCH_INPUTS:
+            receiveData(&pi.frame, sizeof(unsigned long));
+            receiveData(&pi.inputs, sizeof(struct AllInputs));
+            prefetchedInputs.push_back(pi);
+            break;
+
+        case MSGN_PREFETCH_FLUSH:
+            debuglog(LCF_SOCKET | LCF_FRAME, "Discarding ", prefetchedInputs.size(), " prefetched frames");
+            prefetchedInputs.clear();
+            break;
+    }
+    return true;
+}
+
+/* If linTAS already sent us the inputs of the current frame, use them and
+ * just notify linTAS, without waiting for an answer.
+ * Returns false if we must do a regular frame boundary exchange.
+ */
+static bool usePrefetchedInputs(void)
+{
+    /* Process the messages that linTAS sent in the meantime, which may
+     * include more inputs, a tasflags update or a flush. This must be done
+     * even with no inputs left, because linTAS sends the next ones right
+     * after a regular frame boundary exchange.
+     */
+    while (isDataPending()) {
+        if (!proceed_message(receiveMessage()))
+            break;
+    }
+
+    /* Discard outdated inputs */
+    while (!prefetchedInputs.empty() && (prefetchedInputs.front().frame < frame_counter))
+        prefetchedInputs.pop_front();
+
+    if (prefetchedInputs.empty() || (prefetchedInputs.front().frame != frame_counter))
+        return false;
+
+    ai = prefetchedInputs.front().inputs;
+    prefetchedInputs.pop_front();
+
+    sendMessage(MSGB_PREFETCHED_FRAME);
+    sendData(&frame_counter, sizeof(unsigned long));
+    flushMessages();
+    return true;
+}
+
+/* Game window identifier waiting to be sent to linTAS */
+static std::mutex windowIdMutex;
+static bool windowIdPending = false;
+static Window windowId = 0;
+
+void sendWindowId(Window w)
+{
+    std::lock_guard<std::mutex> lock(windowIdMutex);
+    windowId = w;
+    windowIdPending = true;
+}
+
 std::mutex frameMutex;
 
 #ifdef LIBTAS_ENABLE_HUD
@@ -95,10 +224,17 @@ void frameBoundary(bool drawFB, std::function<void()> draw, RenderHUD& hud)
 void frameBoundary(bool drawFB, std::function<void()> draw)
 #endif
 {
-    std::lock_guard<std::mutex> guard(frameMutex);
+    std::unique_lock<std::mutex> guard(frameMutex);
     debuglog(LCF_TIMEFUNC | LCF_FRAME, "Enter frame boundary");
 
-    detTimer.enterFrameBoundary();
+#ifdef LIBTAS_ENABLE_FRAME_PROFILING
+    uint64_t startTime = PhaseTimer::now();
+#endif
+
+    {
+        PROFILE_PHASE(timer);
+        detTimer.enterFrameBoundary();
+    }
 
     /* Audio mixing is done above, so encode must be called after */
 #ifdef LIBTAS_ENABLE_AVDUMPING
@@ -114,35 +250,106 @@ void frameBoundary(bool drawFB, std::function<void()> draw)
     }
 #endif
 
+    /* Statistics of the memory manager, taken once for the HUD and the program */
+    MemoryStats memoryStats;
+    bool memoryStatsWanted = config.custom_memorymanager && (tasflags.memory_stats || config.hud_memory);
+    if (memoryStatsWanted) {
+        memorymanager.takeStats(memoryStats);
+        memoryStats.frame = frame_counter;
+    }
+
 #ifdef LIBTAS_ENABLE_HUD
     if (config.hud_framecount)
         hud.renderFrame(frame_counter);
     if (config.hud_inputs)
         hud.renderInputs(ai);
+    if (config.hud_memory && memoryStatsWanted)
+        hud.renderMemory(memoryStats);
 #endif
 
-    threadState.setNative(true);
-    if (!skipDraw())
-        draw();
-    threadState.setNative(false);
+    {
+        PROFILE_PHASE(draw);
+        threadState.setNative(true);
+        if (!skipDraw())
+            draw();
+        threadState.setNative(false);
+    }
 
-    sendMessage(MSGB_START_FRAMEBOUNDARY);
-    sendData(&frame_counter, sizeof(unsigned long));
+    {
+        std::lock_guard<std::mutex> lock(windowIdMutex);
+        if (windowIdPending) {
+            sendMessage(MSGB_WINDOW_ID);
+            sendData(&windowId, sizeof(Window));
+            windowIdPending = false;
+        }
+    }
+
+    /* Statistics of the time queries of this frame, sent along with the
+     * next message */
+    if (tasflags.timecall_stats) {
+        TimeCallStats timeStats;
+        detTimer.takeStats(timeStats);
+        timeStats.frame = frame_counter;
+        sendMessage(MSGB_TIMECALL_STATS);
+        sendData(&timeStats, sizeof(struct TimeCallStats));
+    }
+
+    if (tasflags.memory_stats && memoryStatsWanted) {
+        sendMessage(MSGB_MEMORY_STATS);
+        sendData(&memoryStats, sizeof(struct MemoryStats));
+    }
 
-    proceed_commands();
+    /* Keep the allocation trace complete up to this frame, in case the game crashes */
+    flushAllocTrace();
 
-    /* Push native SDL events into our emulated event queue */
-    pushNativeEvents();
+#ifdef LIBTAS_ENABLE_FRAME_PROFILING
+    /* Sent along with the next message, in the same write */
+    if (frame_counter > 0) {
+        sendMessage(MSGB_FRAME_TIMINGS);
+        sendData(&lastFrameTimings, sizeof(struct FrameTimings));
+    }
+#endif
+
+    {
+        /* The time blocked on the socket is counted inside, and removed below */
+        PROFILE_PHASE(commands);
+        if (!usePrefetchedInputs()) {
+            sendMessage(MSGB_START_FRAMEBOUNDARY);
+            sendData(&frame_counter, sizeof(unsigned long));
+
+            proceed_commands();
+        }
+    }
+#ifdef LIBTAS_ENABLE_FRAME_PROFILING
+    frameTimings.commands -= frameTimings.ipc_wait;
+#endif
 
-    /* Push generated events.
-     * This must be done after getting the new inputs. */
-    generateSDLKeyUpEvents();
-    generateSDLKeyDownEvents();
-    if (frame_counter == 0)
-        generateSDLControllerAdded();
-    generateSDLControllerEvents();
-    generateSDLMouseMotionEvents();
-    generateSDLMouseButtonEvents();
+    /* The time query statistics are not taken while they are disabled.
+     * When they are enabled, drop what was counted until now, so that the
+     * next statistics only cover the next frame. */
+    static bool timeStatsEnabled = false;
+    if (tasflags.timecall_stats && !timeStatsEnabled) {
+        TimeCallStats droppedStats;
+        detTimer.takeStats(droppedStats);
+    }
+    timeStatsEnabled = tasflags.timecall_stats;
+
+    {
+        PROFILE_PHASE(events);
+
+        /* Push native SDL events into our emulated event queue */
+        pushNativeEvents();
+
+        /* Push generated events.
+         * This must be done after getting the new inputs. */
+        generateSDLKeyUpEvents();
+        generateSDLKeyDownEvents();
+        if (frame_counter == 0)
+            generateSDLControllerAdded();
+        generateSDLControllerEvents();
+        generateSDLMouseMotionEvents();
+        generateSDLMouseButtonEvents();
+    }
 
     ++frame_counter;
 
@@ -153,31 +360,35 @@ void frameBoundary(bool drawFB, std::function<void()> draw)
         updateTitle(fps, lfps);
     }
 
-    detTimer.exitFrameBoundary();
-    debuglog(LCF_TIMEFUNC | LCF_FRAME, "Leave frame boundary");
-}
-
-void proceed_commands(void)
-{
-    int message;
-    while (1)
     {
-        receiveData(&message, sizeof(int));
+        PROFILE_PHASE(timer);
+        detTimer.exitFrameBoundary();
+    }
 
-        switch (message)
-        {
-            case MSGN_TASFLAGS:
-                receiveData(&tasflags, sizeof(struct TasFlags));
-                break;
+#ifdef LIBTAS_ENABLE_FRAME_PROFILING
+    frameTimings.total = PhaseTimer::now() - startTime;
+    lastFrameTimings = frameTimings;
+    frameTimings = FrameTimings();
+#endif
 
-            case MSGN_END_FRAMEBOUNDARY:
-                return;
+    debuglog(LCF_TIMEFUNC | LCF_FRAME, "Leave frame boundary");
+    guard.unlock();
 
-            case MSGN_ALL_INPUTS:
-                receiveData(&ai, sizeof(struct AllInputs));
-                break;
+    /* Run the emulated SDL timers that expired during the frame. Their
+     * callbacks are game code that may draw, sleep or wait for another
+     * thread, so they must not run inside the frame boundary. */
+    fireSDLTimers(detTimer.getFrameTicks());
+}
 
-        }
-    }
+/* Wait for the next message from linTAS */
+static int waitMessage(void)
+{
+    PROFILE_PHASE(ipc_wait);
+    return receiveMessage();
+}
+
+void proceed_commands(void)
+{
+    while (proceed_message(waitMessage())) {}
 }
 
@@ -21,6 +21,7 @@
 #define LIBTAS_FRAME_H_INCL
 
 #include <functional>
+#include <X11/X.h>
 #include "renderhud/RenderHUD.h"
 
 /* Called to initiate a frame boundary.
@@ -42,4 +43,10 @@ void frameBoundary(bool drawFB, std::function<void()> draw);
 /* Process messages that are received from linTAS */
 void proceed_commands(void);
 
+/* Send the identifier of the game window to linTAS during the next frame
+ * boundary. Windows can be created by any thread, but the socket is only
+ * used inside frame boundaries.
+ */
+void sendWindowId(Window w);
+
 #endif
@@ -36,6 +36,7 @@
 #include "../shared/AllInputs.h"
 #include "hook.h"
 #include "inputs/inputs.h"
+#include "memory/AllocTrace.h"
 #ifdef LIBTAS_ENABLE_AVDUMPING
 #include "avdumping.h"
 #endif
@@ -62,6 +63,8 @@ void __attribute__((constructor)) init(void)
     if (! didConnect)
         return;
 
+    openAllocTrace();
+
     /* Send information to the program */
 
     /* Send game process pid */
@@ -74,8 +77,7 @@ void __attribute__((constructor)) init(void)
     sendMessage(MSGB_END_INIT);
 
     /* Receive information from the program */
-    int message;
-    receiveData(&message, sizeof(int));
+    int message = receiveMessage();
     libraries = new safe::vector<safe::string>;
     while (message != MSGN_END_INIT) {
         std::vector<char> buf;
@@ -109,7 +111,7 @@ void __attribute__((constructor)) init(void)
                 debuglog(LCF_ERROR | LCF_SOCKET, "Unknown socket message ", message);
                 exit(1);
         }
-        receiveData(&message, sizeof(int));
+        message = receiveMessage();
     }
     
     ai.emptyInputs();
@@ -119,7 +121,6 @@ void __attribute__((constructor)) init(void)
     /* We initialize our dl functions hooking, and link some functions */
     link_time();
     link_sleep();
-    link_sdltimer();
     link_pthread();
 
     /* Initialize timers */
@@ -136,6 +137,8 @@ void __attribute__((destructor)) term(void)
 
     closeSocket();
 
+    closeAllocTrace();
+
     debuglog(LCF_SOCKET, "Exiting.");
 }
 
@@ -258,6 +261,7 @@ void __attribute__((destructor)) term(void)
 #endif
 
     sendMessage(MSGB_QUIT);
+    flushMessages();
     orig::SDL_Quit();
 }
 
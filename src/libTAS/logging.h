@@ -28,6 +28,7 @@
 #include "hook.h" // For pthread_self_real
 #include "time.h" // For frame_counter
 #include "ThreadState.h"
+#include "../shared/tasflags.h"
 #include <cstdio>
 
 /* Color printing
@@ -100,6 +101,11 @@ void debuglog(LogCategoryFlag lcf, Args ...args);
 template<typename ...Args>
 inline void debuglog(LogCategoryFlag lcf, Args ...args)
 {
+    /* Most messages are filtered out, check this before building anything,
+     * because some hooks are called many times per frame */
+    if (!(lcf & tasflags.includeFlags) || (lcf & tasflags.excludeFlags))
+        return;
+
     /* Not printing anything if thread state is set to NOLOG */
     if (threadState.isNoLog())
         return;
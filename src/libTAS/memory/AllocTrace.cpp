@@ -0,0 +1,305 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AllocTrace.h"
+#include "../ThreadState.h"
+#include "../time.h" // frame_counter
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/* Trace file, or -1 if tracing is disabled. It is read without the lock
+ * to skip tracing quickly */
+static std::atomic<int> trace_fd(-1);
+
+/* Records are written by batches */
+static const int TRACE_BUFFER_SIZE = 4096;
+static AllocTraceRecord trace_buffer[TRACE_BUFFER_SIZE];
+static int trace_count = 0;
+
+/* Id of the next allocation */
+static uint32_t next_id = 1;
+
+/* Number of threads that recorded an allocation */
+static uint16_t thread_count = 0;
+
+/* Index of the current thread plus one, or 0 if not assigned yet */
+static thread_local uint16_t thread_index = 0;
+
+/* Protects everything above. It is a spinlock, like the memory manager
+ * one, because we are called from inside malloc */
+static std::atomic_flag trace_lock = ATOMIC_FLAG_INIT;
+
+static void lock() {while (trace_lock.test_and_set() == true) {}}
+static void unlock() {trace_lock.clear();}
+
+/*
+ * Map of the addresses of live recorded allocations to their ids. It is an
+ * open addressing hash table with linear probing, stored in anonymous
+ * mappings because we cannot use malloc here.
+ */
+struct TraceEntry {
+    uintptr_t addr;
+    uint32_t id;
+};
+
+/* Address of a removed entry */
+static const uintptr_t TOMBSTONE = 1;
+
+static TraceEntry* table = nullptr;
+static size_t table_capacity = 0;
+
+/* Number of live and removed entries */
+static size_t table_live = 0;
+static size_t table_filled = 0;
+
+static size_t hashAddress(uintptr_t addr)
+{
+    return ((addr >> 4) * 0x9E3779B97F4A7C15ull) >> 20;
+}
+
+static bool resizeTable()
+{
+    size_t capacity = 4096;
+    while (capacity < 4 * (table_live + 1))
+        capacity <<= 1;
+
+    void* mem = mmap(nullptr, capacity * sizeof(TraceEntry), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return false;
+
+    /* Anonymous pages are zeroed, so that all entries are empty */
+    TraceEntry* newtable = static_cast<TraceEntry*>(mem);
+    for (size_t i = 0; i < table_capacity; i++) {
+        if (table[i].addr <= TOMBSTONE)
+            continue;
+        size_t j = hashAddress(table[i].addr) & (capacity - 1);
+        while (newtable[j].addr)
+            j = (j + 1) & (capacity - 1);
+        newtable[j] = table[i];
+    }
+
+    if (table)
+        munmap(table, table_capacity * sizeof(TraceEntry));
+    table = newtable;
+    table_capacity = capacity;
+    table_filled = table_live;
+    return true;
+}
+
+static void insertAddress(uintptr_t addr, uint32_t id)
+{
+    if (2 * (table_filled + 1) > table_capacity) {
+        if (!resizeTable())
+            return;
+    }
+
+    TraceEntry* free_entry = nullptr;
+    size_t i = hashAddress(addr) & (table_capacity - 1);
+    for (; table[i].addr; i = (i + 1) & (table_capacity - 1)) {
+        if (table[i].addr == addr) {
+            /* We missed the free of the previous allocation */
+            table[i].id = id;
+            return;
+        }
+        if (!free_entry && (table[i].addr == TOMBSTONE))
+            free_entry = &table[i];
+    }
+
+    if (!free_entry) {
+        free_entry = &table[i];
+        table_filled++;
+    }
+    free_entry->addr = addr;
+    free_entry->id = id;
+    table_live++;
+}
+
+/* Remove an address from the table and return its id, or 0 if unknown */
+static uint32_t removeAddress(uintptr_t addr)
+{
+    if (!table)
+        return 0;
+
+    for (size_t i = hashAddress(addr) & (table_capacity - 1); table[i].addr; i = (i + 1) & (table_capacity - 1)) {
+        if (table[i].addr == addr) {
+            table[i].addr = TOMBSTONE;
+            table_live--;
+            return table[i].id;
+        }
+    }
+    return 0;
+}
+
+static void writeBuffer()
+{
+    const char* data = reinterpret_cast<const char*>(trace_buffer);
+    size_t len = trace_count * sizeof(AllocTraceRecord);
+    while (len > 0) {
+        ssize_t ret = write(trace_fd, data, len);
+        if (ret <= 0)
+            break;
+        data += ret;
+        len -= ret;
+    }
+    trace_count = 0;
+}
+
+void openAllocTrace()
+{
+    const char* path = getenv("LIBTAS_ALLOC_TRACE");
+    if (!path || !path[0])
+        return;
+
+    /*
+     * Call the system directly, because open() may be hooked, and it must
+     * not handle the trace as a savefile of the game. Our own allocations
+     * are not recorded while we write the header.
+     */
+    threadState.setNative(true);
+    int fd = syscall(SYS_openat, AT_FDCWD, path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        AllocTraceHeader header;
+        memcpy(header.magic, ALLOCTRACE_MAGIC, sizeof(header.magic));
+        header.version = ALLOCTRACE_VERSION;
+        header.record_size = sizeof(AllocTraceRecord);
+        if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+            syscall(SYS_close, fd);
+            fd = -1;
+        }
+    }
+    threadState.setNative(false);
+
+    trace_fd = fd;
+}
+
+static void addRecord(uint8_t op, size_t size, uint32_t id, uint32_t old_id, uint8_t align_shift)
+{
+    if (!thread_index)
+        thread_index = ++thread_count;
+
+    AllocTraceRecord& record = trace_buffer[trace_count++];
+    record.op = op;
+    record.align_shift = align_shift;
+    record.thread = thread_index - 1;
+    record.frame = frame_counter;
+    record.id = id;
+    record.old_id = old_id;
+    record.size = size;
+
+    if (trace_count == TRACE_BUFFER_SIZE)
+        writeBuffer();
+}
+
+void traceAllocation(AllocTraceOp op, size_t size, void* addr, size_t align)
+{
+    if (!addr || threadState.isNative() || (trace_fd < 0))
+        return;
+
+    lock();
+    if (trace_fd >= 0) {
+        uint8_t align_shift = 0;
+        if (align > 1)
+            align_shift = 63 - __builtin_clzll(align);
+
+        uint32_t id = next_id++;
+        insertAddress(reinterpret_cast<uintptr_t>(addr), id);
+        addRecord(op, size, id, 0, align_shift);
+    }
+    unlock();
+}
+
+void traceReallocation(void* oldaddr, size_t size, void* newaddr)
+{
+    if (trace_fd < 0)
+        return;
+
+    /* realloc(ptr, 0) frees the memory */
+    if (!newaddr && (size == 0)) {
+        traceFree(oldaddr);
+        return;
+    }
+
+    /* A failed reallocation leaves the old memory untouched */
+    if (!newaddr)
+        return;
+
+    if (!oldaddr) {
+        traceAllocation(ALLOCTRACE_REALLOC, size, newaddr, 0);
+        return;
+    }
+
+    lock();
+    if (trace_fd >= 0) {
+        uint32_t old_id = removeAddress(reinterpret_cast<uintptr_t>(oldaddr));
+        if (old_id || !threadState.isNative()) {
+            uint32_t id = next_id++;
+            insertAddress(reinterpret_cast<uintptr_t>(newaddr), id);
+            addRecord(ALLOCTRACE_REALLOC, size, id, old_id, 0);
+        }
+    }
+    unlock();
+}
+
+void traceFree(void* addr)
+{
+    if (!addr || (trace_fd < 0))
+        return;
+
+    lock();
+    if (trace_fd >= 0) {
+        uint32_t id = removeAddress(reinterpret_cast<uintptr_t>(addr));
+        if (id)
+            addRecord(ALLOCTRACE_FREE, 0, id, 0, 0);
+    }
+    unlock();
+}
+
+void flushAllocTrace()
+{
+    if (trace_fd < 0)
+        return;
+
+    lock();
+    if (trace_fd >= 0)
+        writeBuffer();
+    unlock();
+}
+
+void closeAllocTrace()
+{
+    if (trace_fd < 0)
+        return;
+
+    lock();
+    int fd = trace_fd;
+    if (fd >= 0)
+        writeBuffer();
+    trace_fd = -1;
+    unlock();
+
+    /* close() may be hooked, so it is not called with the lock held */
+    if (fd >= 0)
+        syscall(SYS_close, fd);
+}
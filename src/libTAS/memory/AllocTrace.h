@@ -0,0 +1,56 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_ALLOCTRACE_H_INCL
+#define LIBTAS_ALLOCTRACE_H_INCL
+
+#include "../../shared/AllocTrace.h"
+#include <cstddef>
+
+/*
+ * Capture of the allocations of the game, see shared/AllocTrace.h for the
+ * format. It is enabled from the start of the game by the LIBTAS_ALLOC_TRACE
+ * environment variable, because most allocations are done when loading,
+ * before we get the tas flags from the program.
+ *
+ * Allocations are only recorded in a non-native thread state, so that our
+ * own allocations are left out. Frees and reallocations are recorded for
+ * the addresses that were recorded. None of these functions allocate.
+ */
+
+/* Open the trace file if LIBTAS_ALLOC_TRACE is set. Called once from our
+ * constructor, before anything is recorded */
+void openAllocTrace();
+
+/* Record an allocation that returned addr */
+void traceAllocation(AllocTraceOp op, size_t size, void* addr, size_t align);
+
+/* Record a reallocation from oldaddr to newaddr */
+void traceReallocation(void* oldaddr, size_t size, void* newaddr);
+
+/* Record a deallocation */
+void traceFree(void* addr);
+
+/* Write the buffered records into the trace file */
+void flushAllocTrace();
+
+/* Flush and close the trace file */
+void closeAllocTrace();
+
+#endif
@@ -22,10 +22,19 @@
 #include <cstdint>
 #include <sys/mman.h>
 #include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include "../logging.h"
+#include "../../shared/instance.h"
+#include "../../shared/Config.h"
 
 #include "MemoryManager.h"
 
+/* Older headers do not know this flag, which older kernels ignore */
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
 /* Did we initialize our memory manager? *Must* be global */
 bool mminited = false;
 
@@ -49,12 +58,643 @@ static uint8_t newId(uint8_t a, uint8_t b) {
     return c;
 }
 
+/*
+ * Size class of a small allocation. Sizes up to 128 bytes are rounded up to
+ * a multiple of 16 bytes. Above, each power of two is split into four
+ * classes, up to SLAB_MAX_SIZE bytes. All classes are multiples of 16 bytes.
+ */
+static int slabClass(uint32_t size)
+{
+    if (size <= 128)
+        return (size - 1) >> 4;
+    uint32_t s = size - 1;
+    int p = 31 - __builtin_clz(s);
+    return 8 + (p - 7) * 4 + ((s >> (p - 2)) & 3);
+}
+
+/* Object size of a size class */
+static uint32_t slabClassSize(int size_class)
+{
+    if (size_class < 8)
+        return 16 * (size_class + 1);
+    int g = (size_class - 8) / 4;
+    int sub = (size_class - 8) % 4;
+    return (128u << g) + (sub + 1) * (32u << g);
+}
+
+void MemoryManager::linkSlab(SlabDescription* slab)
+{
+    SlabDescription* head = state->partial_slabs[slab->size_class];
+    slab->prev = nullptr;
+    slab->next = head;
+    if (head)
+        head->prev = slab;
+    state->partial_slabs[slab->size_class] = slab;
+}
+
+void MemoryManager::unlinkSlab(SlabDescription* slab)
+{
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        state->partial_slabs[slab->size_class] = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+    slab->next = nullptr;
+    slab->prev = nullptr;
+}
+
+SlabDescription* MemoryManager::newSlab(int size_class)
+{
+    SlabDescription* slab = state->free_slabs;
+    if (slab) {
+        state->free_slabs = slab->next;
+    }
+    else {
+        if (!state->slab_arena || (state->slab_arena_used == SLAB_ARENA_SIZE)) {
+            if (state->slab_arena_count == MAX_SLAB_ARENAS)
+                return nullptr;
+
+            off_t offset = file_size;
+            uint8_t* arena = mapNewRegion(SLAB_ARENA_SIZE, MemoryManager::ALLOC_WRITE);
+            if (!arena)
+                return nullptr;
+
+            if (!indexRegion(arena, SLAB_ARENA_SIZE, reinterpret_cast<uintptr_t>(arena) | INDEX_SLAB_ARENA)) {
+                indexRegion(arena, SLAB_ARENA_SIZE, 0);
+                unmapRegion(arena, SLAB_ARENA_SIZE, offset);
+                return nullptr;
+            }
+
+            state->slab_arenas[state->slab_arena_count++] = arena;
+
+            state->slab_arena = arena;
+            state->slab_arena_used = 0;
+            debuglogstdio(LCF_MEMORY, "Create new slab arena of address %p", arena);
+        }
+        slab = reinterpret_cast<SlabDescription*>(state->slab_arena + state->slab_arena_used);
+        state->slab_arena_used += SLAB_SIZE;
+    }
+
+    slab->free_list = nullptr;
+    slab->object_size = slabClassSize(size_class);
+    slab->capacity = (SLAB_SIZE - size_of_slab) / slab->object_size;
+    slab->used = 0;
+    slab->bump = 0;
+    slab->size_class = size_class;
+    linkSlab(slab);
+    return slab;
+}
+
+bool MemoryManager::indexRegion(uint8_t* addr, size_t size, uintptr_t owner)
+{
+    static const size_t node_size = (static_cast<size_t>(1) << INDEX_BITS) * sizeof(void*);
+    static const uint64_t mask = (static_cast<uint64_t>(1) << INDEX_BITS) - 1;
+
+    if (!state->block_index) {
+        uintptr_t*** root = reinterpret_cast<uintptr_t***>(mapNewRegion(node_size, MemoryManager::ALLOC_WRITE));
+        if (!root)
+            return false;
+        __atomic_store_n(&state->block_index, root, __ATOMIC_RELEASE);
+    }
+
+    /* Nodes are fresh pages of the file, so they are already zeroed */
+    uint64_t first = reinterpret_cast<uintptr_t>(addr) >> INDEX_PAGE_SHIFT;
+    uint64_t last = (reinterpret_cast<uintptr_t>(addr) + size - 1) >> INDEX_PAGE_SHIFT;
+    for (uint64_t page = first; page <= last; page++) {
+        /* Entries are published atomically, because lookups from
+         * thread caches are done without the lock */
+        uintptr_t*** node_slot = &state->block_index[(page >> (2 * INDEX_BITS)) & mask];
+        uintptr_t** node = *node_slot;
+        if (!node) {
+            node = reinterpret_cast<uintptr_t**>(mapNewRegion(node_size, MemoryManager::ALLOC_WRITE));
+            if (!node)
+                return false;
+            __atomic_store_n(node_slot, node, __ATOMIC_RELEASE);
+        }
+        uintptr_t** leaf_slot = &node[(page >> INDEX_BITS) & mask];
+        uintptr_t* leaf = *leaf_slot;
+        if (!leaf) {
+            leaf = reinterpret_cast<uintptr_t*>(mapNewRegion(node_size, MemoryManager::ALLOC_WRITE));
+            if (!leaf)
+                return false;
+            __atomic_store_n(leaf_slot, leaf, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&leaf[page & mask], owner, __ATOMIC_RELEASE);
+    }
+    return true;
+}
+
+uintptr_t MemoryManager::lookupIndex(uint8_t* address)
+{
+    static const uint64_t mask = (static_cast<uint64_t>(1) << INDEX_BITS) - 1;
+
+    uintptr_t*** root = __atomic_load_n(&state->block_index, __ATOMIC_ACQUIRE);
+    if (!root)
+        return 0;
+
+    uint64_t page = reinterpret_cast<uintptr_t>(address) >> INDEX_PAGE_SHIFT;
+    uintptr_t** node = __atomic_load_n(&root[(page >> (2 * INDEX_BITS)) & mask], __ATOMIC_ACQUIRE);
+    if (!node)
+        return 0;
+    uintptr_t* leaf = __atomic_load_n(&node[(page >> INDEX_BITS) & mask], __ATOMIC_ACQUIRE);
+    if (!leaf)
+        return 0;
+    return __atomic_load_n(&leaf[page & mask], __ATOMIC_ACQUIRE);
+}
+
+SlabDescription* MemoryManager::findSlab(uint8_t* address)
+{
+    uintptr_t owner = lookupIndex(address);
+    if ((owner & INDEX_TAG_MASK) != INDEX_SLAB_ARENA)
+        return nullptr;
+
+    uint8_t* arena = reinterpret_cast<uint8_t*>(owner & ~INDEX_TAG_MASK);
+    uintptr_t offset = address - arena;
+    return reinterpret_cast<SlabDescription*>(arena + (offset & ~static_cast<uintptr_t>(SLAB_SIZE - 1)));
+}
+
+MemoryObjectDescription* MemoryManager::findBlock(uint8_t* address)
+{
+    uintptr_t owner = lookupIndex(address);
+    if (!owner || (owner & INDEX_TAG_MASK))
+        return nullptr;
+
+    MemoryObjectDescription* mod = reinterpret_cast<MemoryObjectDescription*>(owner);
+    uint8_t* mod_addr = reinterpret_cast<uint8_t*>(mod) + size_of_mod;
+    if (address > mod_addr && address < mod_addr + mod->size)
+        return mod;
+    return nullptr;
+}
+
+LargeDescription* MemoryManager::findLarge(uint8_t* address)
+{
+    uintptr_t owner = lookupIndex(address);
+    if ((owner & INDEX_TAG_MASK) != INDEX_LARGE)
+        return nullptr;
+
+    LargeDescription* large = reinterpret_cast<LargeDescription*>(owner & ~INDEX_TAG_MASK);
+    if (large->size && (large->addr == address))
+        return large;
+    return nullptr;
+}
+
+size_t MemoryManager::largeCapacity(size_t size)
+{
+    /*
+     * Reserve up to twice the size, so that growing allocations can be
+     * resized in place. The extra room is never touched until the
+     * allocation grows, so it does not use any memory.
+     */
+    size_t capacity = allocation_granularity;
+    while (capacity < size)
+        capacity <<= 1;
+    return capacity;
+}
+
+uint8_t* MemoryManager::allocateLarge(size_t size, int flags)
+{
+    size_t capacity = largeCapacity(size);
+
+    /* Look for a free extent of a similar size */
+    for (LargeDescription** prev = &state->free_extents; *prev; prev = &(*prev)->next) {
+        LargeDescription* large = *prev;
+        if ((large->capacity >= size) && (large->capacity <= 2 * capacity)) {
+            *prev = large->next;
+            large->next = nullptr;
+            large->size = size;
+            state->large_in_use += size;
+            state->large_count++;
+
+            /* Free extents were released, unless it failed */
+            if ((flags & MemoryManager::ALLOC_ZEROINIT) && !large->zeroed) {
+                memset(large->addr, 0, size);
+            }
+            return large->addr;
+        }
+    }
+
+    LargeDescription* large = reinterpret_cast<LargeDescription*>(allocateUnprotected(sizeof(LargeDescription), MemoryManager::ALLOC_WRITE, 0));
+    if (!large)
+        return nullptr;
+
+    /* Huge pages must also be aligned inside the file */
+    off_t unaligned_size = file_size;
+    bool huge = config.memorymanager_hugepages && (capacity >= HUGE_PAGE_SIZE);
+    if (huge)
+        file_size = (file_size + HUGE_PAGE_SIZE - 1) & ~static_cast<off_t>(HUGE_PAGE_SIZE - 1);
+
+    off_t offset = file_size;
+    uint8_t* addr = mapNewRegion(capacity, flags);
+    if (addr && !indexRegion(addr, capacity, reinterpret_cast<uintptr_t>(large) | INDEX_LARGE)) {
+        /* Clear the pages that were already indexed */
+        indexRegion(addr, capacity, 0);
+        unmapRegion(addr, capacity, offset);
+        addr = nullptr;
+    }
+
+    if (!addr) {
+        /* Remove the alignment padding if nothing was mapped after it */
+        if (file_size == offset) {
+            file_size = unaligned_size;
+            if (ftruncate(fd, file_size) == -1)
+                debuglogstdio(LCF_MEMORY | LCF_ERROR, "Could not shrink shared memory file");
+        }
+        deallocateUnprotected(reinterpret_cast<uint8_t*>(large));
+        return nullptr;
+    }
+
+    if (huge)
+        madvise(addr, capacity, MADV_HUGEPAGE);
+
+    large->addr = addr;
+    large->size = size;
+    large->capacity = capacity;
+    large->file_offset = offset;
+    large->zeroed = false;
+    large->next = nullptr;
+    state->large_in_use += size;
+    state->large_count++;
+    debuglogstdio(LCF_MEMORY, "Create new large extent of address %p and size %zu", addr, capacity);
+
+    /* The extent is made of new pages of the file, which are already zeroed */
+    return addr;
+}
+
+uint8_t* MemoryManager::reallocateLarge(LargeDescription* large, size_t size, int flags)
+{
+    /* Resize in place inside the reserved extent */
+    if (size <= large->capacity) {
+        /* Give back the pages that are not used anymore, up to the end
+         * of the last page of the old size, which belongs to the extent */
+        if (size < large->size) {
+            size_t mask = allocation_granularity - 1;
+            releasePages(large->addr + size, ((large->size + mask) & ~mask) - size);
+        }
+        state->large_in_use = state->large_in_use - large->size + size;
+        large->size = size;
+        return large->addr;
+    }
+
+    size_t capacity = largeCapacity(size);
+
+    /*
+     * If the extent is at the end of the file, we can extend the file and
+     * remap the extent without copying anything. The kernel may move the
+     * mapping to another address if the following range is taken.
+     * With a fixed base, the following range is always ours, and the new
+     * part of the file is simply mapped after the extent.
+     */
+    if (((large->file_offset + static_cast<off_t>(large->capacity)) == file_size) &&
+        (!fixed_base || ((large->file_offset + capacity) <= FIXED_BASE_RESERVED_SIZE))) {
+        if (ftruncate(fd, large->file_offset + capacity) == 0) {
+            void* addr;
+            if (fixed_base) {
+                addr = mmap(large->addr + large->capacity, capacity - large->capacity, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_FIXED, fd, large->file_offset + large->capacity);
+                if (addr != MAP_FAILED)
+                    addr = large->addr;
+            }
+            else {
+                addr = mremap(large->addr, large->capacity, capacity, MREMAP_MAYMOVE);
+            }
+            if (addr != MAP_FAILED) {
+                file_size = large->file_offset + capacity;
+                if (addr != large->addr)
+                    indexRegion(large->addr, large->capacity, 0);
+                if (!indexRegion(static_cast<uint8_t*>(addr), capacity, reinterpret_cast<uintptr_t>(large) | INDEX_LARGE))
+                    debuglogstdio(LCF_MEMORY | LCF_ERROR, "Could not index remapped extent");
+
+                if (config.memorymanager_hugepages && (capacity >= HUGE_PAGE_SIZE))
+                    madvise(addr, capacity, MADV_HUGEPAGE);
+
+                large->addr = static_cast<uint8_t*>(addr);
+                state->large_in_use = state->large_in_use - large->size + size;
+                large->size = size;
+                large->capacity = capacity;
+                return large->addr;
+            }
+
+            /* Give back the new part of the file */
+            if (ftruncate(fd, file_size) == -1)
+                debuglogstdio(LCF_MEMORY | LCF_ERROR, "Could not shrink shared memory file");
+        }
+    }
+
+    /* Otherwise, move to a new extent */
+    uint8_t* newaddr = allocateLarge(size, flags);
+    if (!newaddr)
+        return nullptr;
+
+    memcpy(newaddr, large->addr, large->size);
+    deallocateLarge(large);
+    return newaddr;
+}
+
+void MemoryManager::deallocateLarge(LargeDescription* large)
+{
+    /*
+     * Release the whole extent, including the end of the last page, so
+     * that it reads as zeros when reused. The pages after it were released
+     * when the allocation shrank, or were never used.
+     */
+    size_t mask = allocation_granularity - 1;
+    large->zeroed = releasePages(large->addr, (large->size + mask) & ~mask);
+    state->large_in_use -= large->size;
+    state->large_count--;
+    large->size = 0;
+    large->next = state->free_extents;
+    state->free_extents = large;
+}
+
+bool MemoryManager::releasePages(uint8_t* addr, size_t size)
+{
+    uintptr_t mask = allocation_granularity - 1;
+    uintptr_t start = (reinterpret_cast<uintptr_t>(addr) + mask) & ~mask;
+    uintptr_t end = (reinterpret_cast<uintptr_t>(addr) + size) & ~mask;
+    if (start >= end)
+        return true;
+
+    /* On a shared mapping of the shm file, this punches a hole in the file,
+     * so the pages are not copied in savestates anymore. They read as
+     * zeros if used again. */
+    if (madvise(reinterpret_cast<void*>(start), end - start, MADV_REMOVE) != 0) {
+        debuglogstdio(LCF_MEMORY | LCF_ERROR, "Could not release pages at %p", reinterpret_cast<void*>(start));
+        return false;
+    }
+    return true;
+}
+
+void MemoryManager::releaseFreeBlocks(MemoryObjectDescription* mod, uint32_t first, uint32_t last)
+{
+    /* Only look for whole free pages when a large segment is freed, so that
+     * small frees do not have to scan the bitmap */
+    if ((last - first) * mod->bsize < allocation_granularity)
+        return;
+
+    uint8_t* bm = reinterpret_cast<uint8_t*>(mod) + size_of_mod;
+    uintptr_t data = reinterpret_cast<uintptr_t>(bm);
+    uintptr_t mask = allocation_granularity - 1;
+    uintptr_t start = data + first * mod->bsize;
+    uintptr_t end = data + last * mod->bsize;
+
+    /*
+     * The pages that are partially covered by the segment can be released
+     * if the rest of them is free. The first page of the block holds the
+     * bitmap, whose blocks are never free.
+     */
+    uintptr_t head = start & ~mask;
+    if ((head < start) && (head >= data)) {
+        uint32_t x;
+        for (x = (head - data) / mod->bsize; x < first && bm[x] == 0; ++x) {}
+        if (x == first)
+            start = head;
+    }
+
+    uintptr_t tail = (end + mask) & ~mask;
+    uint32_t max = mod->size / mod->bsize;
+    if ((tail > end) && ((tail - data) / mod->bsize <= max)) {
+        uint32_t tail_block = (tail - data) / mod->bsize;
+        uint32_t x;
+        for (x = last; x < tail_block && bm[x] == 0; ++x) {}
+        if (x == tail_block)
+            end = tail;
+    }
+
+    releasePages(reinterpret_cast<uint8_t*>(start), end - start);
+}
+
+uint8_t* MemoryManager::allocateInSlab(uint32_t size, int flags)
+{
+    int size_class = slabClass(size);
+    SlabDescription* slab;
+    while (true) {
+        slab = state->partial_slabs[size_class];
+        if (!slab) {
+            slab = newSlab(size_class);
+            if (!slab)
+                return nullptr;
+        }
+
+        if (slab->free_list || (slab->bump < slab->capacity))
+            break;
+
+        /* Never hand out objects past the end of the slab, even if the list is corrupted */
+        debuglogstdio(LCF_MEMORY | LCF_ERROR, "Full slab %p was in the list of slabs with free objects", slab);
+        unlinkSlab(slab);
+    }
+
+    uint8_t* addr;
+    if (slab->free_list) {
+        addr = slab->free_list;
+        slab->free_list = *reinterpret_cast<uint8_t**>(addr);
+    }
+    else {
+        addr = reinterpret_cast<uint8_t*>(slab) + size_of_slab + slab->bump * slab->object_size;
+        slab->bump++;
+    }
+
+    /* Full slabs are not kept in the class list */
+    if (++slab->used == slab->capacity)
+        unlinkSlab(slab);
+    state->slab_objects[size_class]++;
+
+    if (flags & MemoryManager::ALLOC_ZEROINIT) {
+        memset(addr, 0, size);
+    }
+
+    return addr;
+}
+
+void MemoryManager::deallocateInSlab(SlabDescription* slab, uint8_t* address)
+{
+    uintptr_t offset = address - reinterpret_cast<uint8_t*>(slab) - size_of_slab;
+    if ((slab->used == 0) || (offset % slab->object_size)) {
+        debuglogstdio(LCF_MEMORY | LCF_ERROR, "Attempted removal of invalid slab memory!");
+        return;
+    }
+
+    *reinterpret_cast<uint8_t**>(address) = slab->free_list;
+    slab->free_list = address;
+    state->slab_objects[slab->size_class]--;
+
+    /* The slab was full, it has free objects again */
+    if (slab->used-- == slab->capacity)
+        linkSlab(slab);
+
+    /*
+     * Give back empty slabs so that other size classes can use them,
+     * but keep the first one of the class to avoid thrashing when
+     * a single object is repeatedly allocated and freed.
+     */
+    if ((slab->used == 0) && (state->partial_slabs[slab->size_class] != slab)) {
+        unlinkSlab(slab);
+        slab->next = state->free_slabs;
+        state->free_slabs = slab;
+
+        /* Keep the page of the header, the objects are not needed anymore */
+        releasePages(reinterpret_cast<uint8_t*>(slab) + allocation_granularity, SLAB_SIZE - allocation_granularity);
+    }
+}
+
+/*
+ * Number of objects moved at once between a thread cache and the slabs.
+ * Around a page worth of objects, between 2 and 32 objects.
+ */
+static uint32_t cacheBatch(uint32_t object_size)
+{
+    uint32_t n = 4096 / object_size;
+    if (n < 2)
+        return 2;
+    if (n > 32)
+        return 32;
+    return n;
+}
+
+thread_local MemoryManager::ThreadCache* MemoryManager::thread_cache = nullptr;
+thread_local pid_t MemoryManager::thread_id = 0;
+
+void MemoryManager::threadCacheDestructor(void*)
+{
+    /* Look for the cache owned by the thread in the current state, which
+     * is not the one we stored if a savestate was loaded since */
+    memorymanager.lock();
+    for (int i = 0; i < memorymanager.state->cache_count; i++) {
+        ThreadCache* tc = &memorymanager.state->caches[i];
+        if (tc->owner != thread_id)
+            continue;
+        for (int c = 0; c < SLAB_CLASS_COUNT; c++)
+            memorymanager.drainCache(tc, c, tc->counts[c]);
+        tc->owner = 0;
+    }
+    memorymanager.unlock();
+    thread_cache = nullptr;
+}
+
+MemoryManager::ThreadCache* MemoryManager::newThreadCache()
+{
+    if (!thread_id)
+        thread_id = syscall(SYS_gettid);
+
+    lock();
+    ThreadCache* cache = nullptr;
+    ThreadCache* free_cache = nullptr;
+    for (int i = 0; i < state->cache_count; i++) {
+        if (state->caches[i].owner == thread_id) {
+            cache = &state->caches[i];
+            break;
+        }
+        if (!free_cache && !state->caches[i].owner)
+            free_cache = &state->caches[i];
+    }
+    if (!cache)
+        cache = free_cache;
+    if (!cache && (state->cache_count < MAX_THREAD_CACHES))
+        cache = &state->caches[state->cache_count++];
+    if (cache)
+        cache->owner = thread_id;
+    unlock();
+
+    if (!cache)
+        return nullptr;
+
+    /* Objects of the cache are given back to the slabs when the thread exits */
+    pthread_setspecific(cache_key, cache);
+    thread_cache = cache;
+    return cache;
+}
+
+void MemoryManager::refillCache(ThreadCache* cache, int size_class)
+{
+    uint32_t object_size = slabClassSize(size_class);
+    uint32_t batch = cacheBatch(object_size);
+    for (uint32_t i = 0; i < batch; i++) {
+        uint8_t* addr = allocateInSlab(object_size, 0);
+        if (!addr)
+            break;
+        *reinterpret_cast<uint8_t**>(addr) = cache->objects[size_class];
+        cache->objects[size_class] = addr;
+        cache->counts[size_class]++;
+    }
+}
+
+void MemoryManager::drainCache(ThreadCache* cache, int size_class, uint32_t count)
+{
+    for (; count > 0 && cache->objects[size_class]; count--) {
+        uint8_t* addr = cache->objects[size_class];
+        cache->objects[size_class] = *reinterpret_cast<uint8_t**>(addr);
+        cache->counts[size_class]--;
+        deallocateInSlab(findSlab(addr), addr);
+    }
+}
+
+uint8_t* MemoryManager::allocateCached(uint32_t size, int flags)
+{
+    ThreadCache* cache = thread_cache;
+    if (!cache || (cache->owner != thread_id)) {
+        cache = newThreadCache();
+        if (!cache)
+            return nullptr;
+    }
+
+    int size_class = slabClass(size);
+    if (!cache->counts[size_class]) {
+        lock();
+        refillCache(cache, size_class);
+        unlock();
+        if (!cache->counts[size_class])
+            return nullptr;
+    }
+
+    uint8_t* addr = cache->objects[size_class];
+    cache->objects[size_class] = *reinterpret_cast<uint8_t**>(addr);
+    cache->counts[size_class]--;
+    cache->allocations++;
+
+    if (flags & MemoryManager::ALLOC_ZEROINIT) {
+        memset(addr, 0, size);
+    }
+
+    return addr;
+}
+
+bool MemoryManager::deallocateCached(uint8_t* address)
+{
+    ThreadCache* cache = thread_cache;
+    if (!cache || (cache->owner != thread_id))
+        return false;
+
+    /*
+     * The index can be read without the lock: the pages of a live object
+     * were indexed before the object was handed out, and the size class
+     * of a slab cannot change while one of its objects is allocated.
+     */
+    SlabDescription* slab = findSlab(address);
+    if (!slab)
+        return false;
+
+    int size_class = slab->size_class;
+    *reinterpret_cast<uint8_t**>(address) = cache->objects[size_class];
+    cache->objects[size_class] = address;
+    cache->counts[size_class]++;
+    cache->deallocations++;
+
+    /* Give back a batch of objects if the cache grows too much */
+    uint32_t batch = cacheBatch(slab->object_size);
+    if (cache->counts[size_class] > 2 * batch) {
+        lock();
+        drainCache(cache, size_class, batch);
+        unlock();
+    }
+    return true;
+}
+
 uint8_t* MemoryManager::allocateInExistingBlock(uint32_t size, int flags, int align) {
     debuglogstdio(LCF_MEMORY, "%s call with bytes %d", __func__, size);
     size = makeBytesAligned(static_cast<intptr_t>(size), global_align);
 
     /* iterate blocks */
-    for (MemoryObjectDescription* mod = fmod; mod; mod = mod->next) {
+    for (MemoryObjectDescription* mod = state->fmod; mod; mod = mod->next) {
         /* check if block has enough room */
         if (mod->size - (mod->used * mod->bsize) >= size) {
 
@@ -103,9 +743,13 @@ uint8_t* MemoryManager::allocateInExistingBlock(uint32_t size, int flags, int al
 
                     uint8_t* addr = reinterpret_cast<uint8_t*>(mod) + size_of_mod + x * mod->bsize;
 
-                    if (flags & MemoryManager::ALLOC_ZEROINIT) {
-                        memset(addr, 0, size);
+                    /* Blocks that were never allocated are still zero */
+                    if ((flags & MemoryManager::ALLOC_ZEROINIT) && (x < mod->fresh)) {
+                        uint32_t dirty = mod->fresh - x;
+                        memset(addr, 0, (dirty < bneed) ? (dirty * mod->bsize) : size);
                     }
+                    if (x + bneed > mod->fresh)
+                        mod->fresh = x + bneed;
 
                     return addr;
                 }
@@ -119,21 +763,8 @@ uint8_t* MemoryManager::allocateInExistingBlock(uint32_t size, int flags, int al
     return nullptr; 
 }
 
-void MemoryManager::newBlock(uint32_t size, int flags)
+uint8_t* MemoryManager::mapNewRegion(size_t size, int flags)
 {
-    debuglogstdio(LCF_MEMORY, "%s call with size %d", __func__, size);
-
-    /*
-     * Calculate the size of the mapped file and make sure the allocation is a multible of
-     * global_align bytes.
-     */
-    size_t block_size = allocation_granularity;
-    size = makeBytesAligned(size, global_align);
-    while (block_size - size_of_mod - makeBytesAligned(block_size / global_align, global_align) < size)
-    {
-        block_size += allocation_granularity;
-    }
-
     int access = 0;
     if (flags & MemoryManager::ALLOC_WRITE)
     {
@@ -152,25 +783,92 @@ void MemoryManager::newBlock(uint32_t size, int flags)
         access |= PROT_EXEC;
     }
 
-    if (ftruncate(fd, file_size + block_size) == -1) {
+    if (fixed_base && ((file_size + static_cast<off_t>(size)) > FIXED_BASE_RESERVED_SIZE)) {
+        debuglogstdio(LCF_MEMORY | LCF_ERROR, "Exhausted the reserved heap range");
+        return nullptr;
+    }
+
+    if (ftruncate(fd, file_size + size) == -1) {
         debuglogstdio(LCF_MEMORY | LCF_ERROR, "Could not extend shared memory file");
-        return;
+        return nullptr;
     }
 
-    void* addr = mmap(0, block_size, access, MAP_SHARED, fd, file_size);
-    file_size += block_size;
+    void* addr;
+    if (fixed_base) {
+        /* Regions are mapped at the same offset as in the file, replacing
+         * the reservation */
+        addr = mmap(fixed_base + file_size, size, access, MAP_SHARED | MAP_FIXED, fd, file_size);
+    }
+    else {
+        addr = mmap(0, size, access, MAP_SHARED, fd, file_size);
+    }
 
     if (addr == MAP_FAILED)
     {
         debuglogstdio(LCF_MEMORY | LCF_ERROR, "Could not create shared memory block");
+
+        /* Give back the new part of the file */
+        if (ftruncate(fd, file_size) == -1)
+            debuglogstdio(LCF_MEMORY | LCF_ERROR, "Could not shrink shared memory file");
+        return nullptr;
+    }
+
+    file_size += size;
+    return static_cast<uint8_t*>(addr);
+}
+
+void MemoryManager::unmapRegion(uint8_t* addr, size_t size, off_t offset)
+{
+    if (fixed_base) {
+        /* Put back the reservation over the range */
+        mmap(addr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    }
+    else {
+        munmap(addr, size);
+    }
+
+    /* Shrink the file if nothing was mapped after the region, for example
+     * index nodes. Otherwise, release its range of the file. */
+    if ((offset + static_cast<off_t>(size)) == file_size) {
+        if (ftruncate(fd, offset) == 0)
+            file_size = offset;
+    }
+    else {
+        fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, size);
+    }
+}
+
+void MemoryManager::newBlock(uint32_t size, int flags)
+{
+    debuglogstdio(LCF_MEMORY, "%s call with size %d", __func__, size);
+
+    /*
+     * Calculate the size of the mapped file and make sure the allocation is a multible of
+     * global_align bytes.
+     */
+    size_t block_size = allocation_granularity;
+    size = makeBytesAligned(size, global_align);
+    while (block_size - size_of_mod - makeBytesAligned(block_size / global_align, global_align) < size)
+    {
+        block_size += allocation_granularity;
+    }
+
+    off_t offset = file_size;
+    uint8_t* addr = mapNewRegion(block_size, flags);
+    if (!addr)
+        return;
+
+    if (!indexRegion(addr, block_size, reinterpret_cast<uintptr_t>(addr))) {
+        indexRegion(addr, block_size, 0);
+        unmapRegion(addr, block_size, offset);
         return;
     }
 
-    MemoryObjectDescription* mod = static_cast<MemoryObjectDescription*>(addr);
+    MemoryObjectDescription* mod = reinterpret_cast<MemoryObjectDescription*>(addr);
     mod->size = block_size - size_of_mod;
     mod->bsize = global_align;
-    mod->next = fmod;
-    fmod = mod;
+    mod->next = state->fmod;
+    state->fmod = mod;
 
     uint32_t bcnt = mod->size / mod->bsize;
     uint8_t* bm = reinterpret_cast<uint8_t*>(mod) + size_of_mod;
@@ -190,18 +888,38 @@ void MemoryManager::newBlock(uint32_t size, int flags)
         debuglogstdio(LCF_MEMORY | LCF_ERROR, "Did not allocate enough size in the new block: %d and %d requested", remaining_size, size);
 
     mod->lfb = bcnt - 1;
+    mod->fresh = bcnt;
     mod->used = bcnt;
     debuglogstdio(LCF_MEMORY, "Create new MOD of address %p and size %d", addr, mod->size);
 
 }
 
-uint8_t* MemoryManager::allocateUnprotected(uint32_t size, int flags, int align)
+uint8_t* MemoryManager::allocateUnprotected(size_t size, int flags, int align)
 {
-    debuglogstdio(LCF_MEMORY, "%s call with size %d", __func__, size);
+    debuglogstdio(LCF_MEMORY, "%s call with size %zu", __func__, size);
 
     if (size == 0) {
         return nullptr;
     }
+
+    /* Small allocations with default alignment are served by slabs */
+    if ((size <= SLAB_MAX_SIZE) && (align <= global_align)) {
+        uint8_t* allocation = allocateInSlab(size, flags);
+        if (allocation) {
+            return allocation;
+        }
+    }
+
+    /* Large allocations with at most page alignment get their own extent */
+    if ((size >= LARGE_THRESHOLD) && (align <= static_cast<int>(allocation_granularity))) {
+        return allocateLarge(size, flags);
+    }
+
+    /* The bitmap heap only handles 32-bit sizes */
+    if (size >= 0x80000000) {
+        return nullptr;
+    }
+
     /*
      * If the allocation needs 50% or more of a block, go preferably for
      * a new block (see below). Otherwise, always try to allocate in 
@@ -229,8 +947,8 @@ uint8_t* MemoryManager::allocateUnprotected(uint32_t size, int flags, int align)
          * always check for existing memory.
          * We may learn from strategies of common malloc allocations.
          */
-        if ((fmod && (fmod->size - (fmod->used * fmod->bsize) >= size)) ||
-            (lmod && (lmod->size - (lmod->used * lmod->bsize) >= size))) {
+        if ((state->fmod && (state->fmod->size - (state->fmod->used * state->fmod->bsize) >= size)) ||
+            (state->lmod && (state->lmod->size - (state->lmod->used * state->lmod->bsize) >= size))) {
             uint8_t* allocation = allocateInExistingBlock(size, flags, align);
             if (allocation) {
                 return allocation;
@@ -248,9 +966,9 @@ uint8_t* MemoryManager::allocateUnprotected(uint32_t size, int flags, int align)
     return allocateInExistingBlock(size, flags, align);
 }
 
-uint8_t* MemoryManager::reallocateUnprotected(uint8_t* address, uint32_t size, int flags)
+uint8_t* MemoryManager::reallocateUnprotected(uint8_t* address, size_t size, int flags)
 {
-    debuglogstdio(LCF_MEMORY, "%s call with address %p and size %d", __func__, address, size);
+    debuglogstdio(LCF_MEMORY, "%s call with address %p and size %zu", __func__, address, size);
 
     if (address == nullptr) {
         return allocateUnprotected(size, flags, 0);
@@ -260,86 +978,114 @@ uint8_t* MemoryManager::reallocateUnprotected(uint8_t* address, uint32_t size, i
         return nullptr;
     }
 
-    for (MemoryObjectDescription *mod = fmod; mod; mod = mod->next) {
-        uint8_t* mod_addr = reinterpret_cast<uint8_t*>(mod) + size_of_mod;
-        if (address > mod_addr && address < mod_addr + mod->size) {
-            /* found block */
-            intptr_t ptroff = reinterpret_cast<intptr_t>(address) - reinterpret_cast<intptr_t>(mod) - size_of_mod;  /* get offset to get block */
-            /* block offset in BM */
-            uint32_t bi = ptroff / mod->bsize;
-            /* .. */
-            uint8_t* bm = reinterpret_cast<uint8_t*>(mod) + size_of_mod;
-            /* clear allocation */
-            uint8_t id = bm[bi];
-            /* Check if we deallocate in the middle of a segment */
-            if (bm[bi-1] == id)
-                debuglogstdio(LCF_MEMORY | LCF_ERROR, "Deallocate in the middle of a segment!");
-
-            uint32_t rb = (size - 1) / mod->bsize + 1; // ceil(size / mod->bsize)
-
-            /* Check if we have enough space for the new size */
-            uint32_t max = mod->size / mod->bsize;
-            uint32_t x;
-            for (x = bi; bm[x] == id && x < max && x - bi < rb; ++x) {}
-
-            uint32_t x0 = x;
-            if (x - bi == rb) {
-                /* reallocate to smaller size. Just reset the rest of the bitmap */
-                for (; bm[x] == id && x < max; ++x) {
-                    bm[x] = 0;
-                }
-                /* update free block count */
-                mod->used -= x - x0;
-                return address;
-            }
+    SlabDescription* slab = findSlab(address);
+    if (slab) {
+        /* Nothing to do if the new size still fits in the object */
+        if (size <= slab->object_size)
+            return address;
 
-            /* Continuing on free blocks */
-            for (; bm[x] == 0 && x < max && x - bi < rb; ++x) {}
-
-            if (x - bi == rb) {
-                /* Reallocate to larger size that fits in the empty blocks */
-
-                /*
-                 * Warning! we must check the id of the next segment. It might
-                 * be a used block with the same id. In that case, we must
-                 * change the id of the current segment
-                 */
-                if (x < max && bm[x] == id) {
-                    /* Detected a segment with same id */
-                    uint8_t nid = newId(bm[bi - 1], bm[x]);
-                    for (x = bi; x - bi < rb; ++x) {
-                        bm[x] = nid;
-                    }
-                }
-                else {
-                    /* Just extend the id on the free blocks */
-                    for (x = x0; x - bi < rb; ++x) {
-                        bm[x] = id;
-                    }
-                }
+        uint8_t* newaddr = allocateUnprotected(size, flags, 0);
+        if (!newaddr) {
+            return nullptr;
+        }
 
-                /* update free block count */
-                mod->used += x - x0;
-                return address;
-            }
+        memcpy(newaddr, address, slab->object_size);
+        deallocateInSlab(slab, address);
+        return newaddr;
+    }
 
-            /* No space left for realloc. Deallocing and alloc elsewhere */
-            for (x = bi; bm[x] == id && x < max; ++x) {
+    LargeDescription* large = findLarge(address);
+    if (large) {
+        return reallocateLarge(large, size, flags);
+    }
+
+    MemoryObjectDescription* mod = findBlock(address);
+    if (mod) {
+        intptr_t ptroff = reinterpret_cast<intptr_t>(address) - reinterpret_cast<intptr_t>(mod) - size_of_mod;  /* get offset to get block */
+        /* block offset in BM */
+        uint32_t bi = ptroff / mod->bsize;
+        /* .. */
+        uint8_t* bm = reinterpret_cast<uint8_t*>(mod) + size_of_mod;
+        /* clear allocation */
+        uint8_t id = bm[bi];
+        /* Check if we deallocate in the middle of a segment */
+        if (bm[bi-1] == id)
+            debuglogstdio(LCF_MEMORY | LCF_ERROR, "Deallocate in the middle of a segment!");
+
+        /* Sizes that do not fit in the bitmap heap can only be moved */
+        uint32_t rb = (size < 0x80000000) ? ((size - 1) / mod->bsize + 1) : UINT32_MAX; // ceil(size / mod->bsize)
+
+        /* Check if we have enough space for the new size */
+        uint32_t max = mod->size / mod->bsize;
+        uint32_t x;
+        for (x = bi; bm[x] == id && x < max && x - bi < rb; ++x) {}
+
+        uint32_t x0 = x;
+        if (x - bi == rb) {
+            /* reallocate to smaller size. Just reset the rest of the bitmap */
+            for (; bm[x] == id && x < max; ++x) {
                 bm[x] = 0;
             }
-
             /* update free block count */
-            mod->used -= x - bi;
+            mod->used -= x - x0;
+            releaseFreeBlocks(mod, x0, x);
+            return address;
+        }
 
-            uint8_t* newaddr = allocateUnprotected(size, flags, 0);
-            if (!newaddr) {
-                return nullptr;
+        /* Continuing on free blocks */
+        for (; bm[x] == 0 && x < max && x - bi < rb; ++x) {}
+
+        if (x - bi == rb) {
+            /* Reallocate to larger size that fits in the empty blocks */
+
+            /*
+             * Warning! we must check the id of the next segment. It might
+             * be a used block with the same id. In that case, we must
+             * change the id of the current segment
+             */
+            if (x < max && bm[x] == id) {
+                /* Detected a segment with same id */
+                uint8_t nid = newId(bm[bi - 1], bm[x]);
+                for (x = bi; x - bi < rb; ++x) {
+                    bm[x] = nid;
+                }
+            }
+            else {
+                /* Just extend the id on the free blocks */
+                for (x = x0; x - bi < rb; ++x) {
+                    bm[x] = id;
+                }
             }
 
-            memmove(newaddr, address, (x - bi) * mod->bsize);
+            /* update free block count */
+            mod->used += x - x0;
+            if (x > mod->fresh)
+                mod->fresh = x;
+            return address;
+        }
 
-            return newaddr;
+        /* No space left for realloc. Deallocing and alloc elsewhere */
+        for (x = bi; bm[x] == id && x < max; ++x) {
+            bm[x] = 0;
         }
+
+        /* update free block count */
+        mod->used -= x - bi;
+
+        uint8_t* newaddr = allocateUnprotected(size, flags, 0);
+        if (!newaddr) {
+            return nullptr;
+        }
+
+        memmove(newaddr, address, (x - bi) * mod->bsize);
+
+        /* The old segment can only be released once copied, and if the
+         * new one does not overlap it */
+        uint8_t* mod_end = reinterpret_cast<uint8_t*>(mod) + size_of_mod + mod->size;
+        if ((newaddr < reinterpret_cast<uint8_t*>(mod)) || (newaddr >= mod_end))
+            releaseFreeBlocks(mod, bi, x);
+
+        return newaddr;
     }
 
     debuglogstdio(LCF_MEMORY | LCF_ERROR, "WARNING: Attempted realloc of unknown memory!");
@@ -355,35 +1101,45 @@ bool MemoryManager::deallocateUnprotected(uint8_t* address)
         return true;
     }
 
-    for (MemoryObjectDescription *mod = fmod; mod; mod = mod->next) {
-        uint8_t* mod_addr = reinterpret_cast<uint8_t*>(mod) + size_of_mod;
-        if (address > mod_addr && address < mod_addr + mod->size) {
-            /* found block */
-            intptr_t ptroff = reinterpret_cast<intptr_t>(address) - reinterpret_cast<intptr_t>(mod) - size_of_mod;  /* get offset to get block */
-            /* Check address alignment */
-            if (ptroff % mod->bsize)
-                debuglogstdio(LCF_MEMORY | LCF_ERROR, "Address not aligned to block size!");
-            /* block offset in BM */
-            uint32_t bi = ptroff / mod->bsize;
-            /* .. */
-            uint8_t* bm = reinterpret_cast<uint8_t*>(mod) + size_of_mod;
-            /* clear allocation */
-            uint8_t id = bm[bi];
-            /* Check if we deallocate in the middle of a segment */
-            if (bm[bi-1] == id)
-                debuglogstdio(LCF_MEMORY | LCF_ERROR, "Deallocate in the middle of a segment!");
-            /* oddly.. GCC did not optimize this */
-            uint32_t max = mod->size / mod->bsize;
-            uint32_t x;
-            for (x = bi; bm[x] == id && x < max; ++x) {
-                bm[x] = 0;
-            }
-            /* update free block count */
-            mod->used -= x - bi;
-            lmod = mod;
-            //mod->lfb = bi - 1;
-            return true;
+    SlabDescription* slab = findSlab(address);
+    if (slab) {
+        deallocateInSlab(slab, address);
+        return true;
+    }
+
+    LargeDescription* large = findLarge(address);
+    if (large) {
+        deallocateLarge(large);
+        return true;
+    }
+
+    MemoryObjectDescription* mod = findBlock(address);
+    if (mod) {
+        intptr_t ptroff = reinterpret_cast<intptr_t>(address) - reinterpret_cast<intptr_t>(mod) - size_of_mod;  /* get offset to get block */
+        /* Check address alignment */
+        if (ptroff % mod->bsize)
+            debuglogstdio(LCF_MEMORY | LCF_ERROR, "Address not aligned to block size!");
+        /* block offset in BM */
+        uint32_t bi = ptroff / mod->bsize;
+        /* .. */
+        uint8_t* bm = reinterpret_cast<uint8_t*>(mod) + size_of_mod;
+        /* clear allocation */
+        uint8_t id = bm[bi];
+        /* Check if we deallocate in the middle of a segment */
+        if (bm[bi-1] == id)
+            debuglogstdio(LCF_MEMORY | LCF_ERROR, "Deallocate in the middle of a segment!");
+        /* oddly.. GCC did not optimize this */
+        uint32_t max = mod->size / mod->bsize;
+        uint32_t x;
+        for (x = bi; bm[x] == id && x < max; ++x) {
+            bm[x] = 0;
         }
+        /* update free block count */
+        mod->used -= x - bi;
+        state->lmod = mod;
+        releaseFreeBlocks(mod, bi, x);
+        //mod->lfb = bi - 1;
+        return true;
     }
 
     debuglogstdio(LCF_MEMORY | LCF_ERROR, "Attempted removal of unknown memory!");
@@ -393,23 +1149,58 @@ bool MemoryManager::deallocateUnprotected(uint8_t* address)
 void MemoryManager::init()
 {
     debuglogstdio(LCF_MEMORY, "%s call", __func__);
-    fd = shm_open("/libtas", O_RDWR | O_CREAT | O_TRUNC, 0666);
+    char shm_name[64];
+    instanceShmName(shm_name, sizeof(shm_name));
+    fd = shm_open(shm_name, O_RDWR | O_CREAT | O_TRUNC, 0666);
     if (fd == -1) {
         debuglogstdio(LCF_MEMORY | LCF_ERROR, "  could not open shared memory file");
         /* Error */
     }
 
-    fmod = nullptr;
-    lmod = nullptr;
+    /*
+     * Reserve the whole address range of the heap, so that the layout only
+     * depends on the sequence of allocations. The reservation does not use
+     * any memory. MAP_FIXED_NOREPLACE is only a hint on kernels older than
+     * 4.17, so we check the address that we got.
+     */
+    fixed_base = nullptr;
+    if (config.memorymanager_fixed_base) {
+        void* base = reinterpret_cast<void*>(FIXED_BASE_ADDRESS);
+        void* addr = mmap(base, FIXED_BASE_RESERVED_SIZE, PROT_NONE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+        if (addr == base) {
+            fixed_base = static_cast<uint8_t*>(addr);
+        }
+        else {
+            if (addr != MAP_FAILED)
+                munmap(addr, FIXED_BASE_RESERVED_SIZE);
+            debuglogstdio(LCF_MEMORY | LCF_ERROR, "  could not reserve the heap at a fixed address");
+        }
+    }
+
     global_align = 16;
     size_of_mod = makeBytesAligned(sizeof(MemoryObjectDescription), global_align);
     allocation_granularity = getpagesize();
     allocation_lock.clear();
     file_size = 0;
+    size_of_slab = makeBytesAligned(sizeof(SlabDescription), global_align);
+
+    /*
+     * The state is the first region of the file, so that it is saved with
+     * the rest of the heap. It is made of fresh pages, so all lists are
+     * empty and all counters are zero.
+     */
+    state = reinterpret_cast<SharedState*>(mapNewRegion(makeBytesAligned(sizeof(SharedState), allocation_granularity), MemoryManager::ALLOC_WRITE));
+    if (!state) {
+        debuglogstdio(LCF_MEMORY | LCF_ERROR, "  could not map the allocator state, savestates will not work");
+        static SharedState local_state;
+        state = &local_state;
+    }
+    pthread_key_create(&cache_key, threadCacheDestructor);
     mminited = true;
 }
 
-void* MemoryManager::allocate(int bytes, int flags, int align)
+void* MemoryManager::allocate(size_t bytes, int flags, int align)
 {
     if (!mminited)
         init();
@@ -426,22 +1217,31 @@ void* MemoryManager::allocate(int bytes, int flags, int align)
         align++;
     }
 
-    while (allocation_lock.test_and_set() == true) {}
+    if ((bytes > 0) && (bytes <= SLAB_MAX_SIZE) && (align <= global_align)) {
+        uint8_t* rv = allocateCached(bytes, flags);
+        if (rv)
+            return static_cast<void*>(rv);
+    }
+
+    lock();
     uint8_t* rv = allocateUnprotected(bytes, flags, align);
+    if (rv)
+        state->allocations++;
     //dumpAllocationTable();
     //checkIntegrity();
-    allocation_lock.clear();
+    unlock();
     if (!rv)
         debuglogstdio(LCF_MEMORY | LCF_ERROR, "WARNING: returning null pointer!");
     return static_cast<void*>(rv);
 }
 
-void* MemoryManager::reallocate(void* address, int bytes, int flags)
+void* MemoryManager::reallocate(void* address, size_t bytes, int flags)
 {
-    while (allocation_lock.test_and_set() == true) {}
+    lock();
     uint8_t* rv = reallocateUnprotected(static_cast<uint8_t*>(address), bytes, flags);
+    state->reallocations++;
     //checkIntegrity();
-    allocation_lock.clear();
+    unlock();
     if (!rv)
         debuglogstdio(LCF_MEMORY | LCF_ERROR, "WARNING: returning null pointer!");
     return static_cast<void*>(rv);
@@ -449,16 +1249,38 @@ void* MemoryManager::reallocate(void* address, int bytes, int flags)
 
 bool MemoryManager::deallocate(void* address)
 {
-    while (allocation_lock.test_and_set() == true) {}
+    if (!address)
+        return true;
+
+    if (deallocateCached(static_cast<uint8_t*>(address)))
+        return true;
+
+    lock();
     bool res = deallocateUnprotected(static_cast<uint8_t*>(address));
+    if (res)
+        state->deallocations++;
     //checkIntegrity();
-    allocation_lock.clear();
+    unlock();
     return res;
 }
 
 void MemoryManager::checkIntegrity()
 {
-    for (MemoryObjectDescription *mod = fmod; mod; mod = mod->next) {
+    for (int a = 0; a < state->slab_arena_count; a++) {
+        uint32_t carved = (state->slab_arenas[a] == state->slab_arena) ? state->slab_arena_used : SLAB_ARENA_SIZE;
+        for (uint32_t off = 0; off < carved; off += SLAB_SIZE) {
+            SlabDescription* slab = reinterpret_cast<SlabDescription*>(state->slab_arenas[a] + off);
+            if (slab->used == 0)
+                continue;
+            uint32_t nfree = 0;
+            for (uint8_t* obj = slab->free_list; obj; obj = *reinterpret_cast<uint8_t**>(obj))
+                nfree++;
+            if (slab->used + nfree != slab->bump)
+                debuglogstdio(LCF_MEMORY | LCF_ERROR, "Incorrect number of objects for slab %p. Used: %d, free: %d, handed out: %d", slab, slab->used, nfree, slab->bump);
+        }
+    }
+
+    for (MemoryObjectDescription *mod = state->fmod; mod; mod = mod->next) {
         uint32_t bused = 0;
         uint8_t* bm = reinterpret_cast<uint8_t*>(mod) + size_of_mod;
         uint32_t max = mod->size / mod->bsize;
@@ -476,7 +1298,18 @@ void MemoryManager::checkIntegrity()
 
 void MemoryManager::dumpAllocationTable()
 {
-    for (MemoryObjectDescription *mod = fmod; mod; mod = mod->next) {
+    for (int a = 0; a < state->slab_arena_count; a++) {
+        uint32_t carved = (state->slab_arenas[a] == state->slab_arena) ? state->slab_arena_used : SLAB_ARENA_SIZE;
+        for (uint32_t off = 0; off < carved; off += SLAB_SIZE) {
+            SlabDescription* slab = reinterpret_cast<SlabDescription*>(state->slab_arenas[a] + off);
+            if (slab->used == 0)
+                debuglogstdio(LCF_MEMORY, "Slab %p empty", slab);
+            else
+                debuglogstdio(LCF_MEMORY, "Slab %p of object size %d: %d/%d used", slab, slab->object_size, slab->used, slab->capacity);
+        }
+    }
+
+    for (MemoryObjectDescription *mod = state->fmod; mod; mod = mod->next) {
         debuglogstdio(LCF_MEMORY, "MOD %p of size %d", mod, mod->size);
         uint8_t* bm = reinterpret_cast<uint8_t*>(mod) + size_of_mod;
         uint32_t max = mod->size / mod->bsize;
@@ -502,5 +1335,64 @@ void MemoryManager::dumpAllocationTable()
     }
 }
 
+void MemoryManager::takeStats(MemoryStats& stats)
+{
+    stats = MemoryStats();
+    if (!mminited)
+        return;
+
+    lock();
+
+    uint64_t bytes = state->large_in_use;
+    for (MemoryObjectDescription *mod = state->fmod; mod; mod = mod->next) {
+        /* Do not count the blocks reserved for the bitmap */
+        uint32_t bcnt = mod->size / mod->bsize;
+        uint32_t reserved = ((bcnt - 1) / mod->bsize) + 1;
+        bytes += static_cast<uint64_t>(mod->used - reserved) * mod->bsize;
+        stats.heapBlocks++;
+    }
+
+    /*
+     * Objects in thread caches are free for the game. Caches are owned by
+     * other threads, so their counters are only read atomically and can
+     * be slightly behind.
+     */
+    uint32_t cached[SLAB_CLASS_COUNT] = {};
+    uint64_t total_allocations = state->allocations;
+    uint64_t total_deallocations = state->deallocations;
+    for (int i = 0; i < state->cache_count; i++) {
+        ThreadCache* cache = &state->caches[i];
+        for (int c = 0; c < SLAB_CLASS_COUNT; c++)
+            cached[c] += __atomic_load_n(&cache->counts[c], __ATOMIC_RELAXED);
+        total_allocations += __atomic_load_n(&cache->allocations, __ATOMIC_RELAXED);
+        total_deallocations += __atomic_load_n(&cache->deallocations, __ATOMIC_RELAXED);
+    }
+
+    for (int c = 0; c < SLAB_CLASS_COUNT; c++) {
+        uint32_t objects = (state->slab_objects[c] > cached[c]) ? (state->slab_objects[c] - cached[c]) : 0;
+        stats.classObjects[c] = objects;
+        bytes += static_cast<uint64_t>(objects) * slabClassSize(c);
+    }
+
+    stats.bytesInUse = bytes;
+    /* Released pages are holes in the file, only count the allocated ones */
+    struct stat filestat;
+    if (fstat(fd, &filestat) == 0)
+        stats.bytesAllocated = static_cast<uint64_t>(filestat.st_blocks) * 512;
+    else
+        stats.bytesAllocated = file_size;
+    stats.slabArenas = state->slab_arena_count;
+    stats.largeExtents = state->large_count;
+
+    stats.allocations = total_allocations - state->last_allocations;
+    stats.reallocations = state->reallocations - state->last_reallocations;
+    stats.deallocations = total_deallocations - state->last_deallocations;
+    state->last_allocations = total_allocations;
+    state->last_reallocations = state->reallocations;
+    state->last_deallocations = total_deallocations;
+
+    unlock();
+}
+
 MemoryManager memorymanager;
 
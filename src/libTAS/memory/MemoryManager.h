@@ -21,6 +21,10 @@
 #define LIBTAS_MEMORYMANAGER_H_INCLUDED
 
 #include <atomic>
+#include <cstdint>
+#include <sys/types.h>
+#include <pthread.h>
+#include "../../shared/MemoryStats.h"
 
 /*
  * Memory Manager
@@ -32,6 +36,21 @@
  * about which blocks are free or used and to distinguish different allocations using ids.
  * As an optimization, it uses a next fit technique where new allocations are preferably done
  * next to recent allocations, in order to improve caching.
+ * Small allocations (up to SLAB_MAX_SIZE bytes) do not go through the bitmap heap. They are
+ * served from slabs: fixed-size regions dedicated to a single size class, which keep freed
+ * objects in an intrusive free list, so that allocation and deallocation are done in constant
+ * time. Slabs are carved from larger arenas that also live in the shared memory file.
+ * Each thread keeps a small cache of free objects per size class, so that most small
+ * allocations and deallocations do not take the global lock. Caches are refilled from
+ * and drained to the slabs in batches.
+ * Large allocations (from LARGE_THRESHOLD bytes) get their own page-aligned extent of the
+ * shared memory file, which reserves extra room so that it can grow in place.
+ * Whole pages that become free are released by punching holes in the shared memory file,
+ * so that savestates, which skip the holes, only hold live data. The list heads and
+ * counters of the manager are stored at the start of the file, so that a savestate
+ * always restores them together with the structures they point to.
+ * Optionally, the whole heap lives in a range reserved at a fixed address, so that the same
+ * sequence of allocations gives the same addresses in every run.
  * Moreover, memory is requested from the system using mmap and is tagged as shared, so that
  * it can easily be accessed from the executable, in order to have an effective RAM Search.
  * Another benefit to shared memory is that it becomes easier to manage save states with
@@ -59,6 +78,67 @@ struct MemoryObjectDescription
 
     /* Index of the block from where we will start searching. Optimization purpose */
     uint32_t lfb;
+
+    /* Index of the first block that was never allocated. The blocks from
+     * there are fresh pages of the file, so zeroed allocations can skip
+     * clearing them */
+    uint32_t fresh;
+};
+
+/*
+ * Structure of the header of a slab. A slab stores objects of a single size
+ * class, located right after the header.
+ */
+struct SlabDescription
+{
+    /* Neighbours in the list of slabs of the same class with free objects,
+     * or in the list of empty slabs */
+    SlabDescription* next;
+    SlabDescription* prev;
+
+    /* Linked list of freed objects. Each free object stores the address of the next one */
+    uint8_t* free_list;
+
+    /* Size of each object in the slab */
+    uint32_t object_size;
+
+    /* Number of objects that fit in the slab */
+    uint32_t capacity;
+
+    /* Number of objects currently allocated */
+    uint32_t used;
+
+    /* Number of objects that were handed out at least once. Objects above
+     * this index were never used and are not in the free list */
+    uint32_t bump;
+
+    /* Index of the size class */
+    int size_class;
+};
+
+/*
+ * Description of an extent that holds a single large allocation.
+ * Descriptions are themselves allocated by the memory manager.
+ */
+struct LargeDescription
+{
+    /* Start address of the extent, which is the address of the allocation */
+    uint8_t* addr;
+
+    /* Size of the allocation, or 0 if the extent is free */
+    size_t size;
+
+    /* Size of the mapped extent */
+    size_t capacity;
+
+    /* Offset of the extent inside the shared memory file */
+    off_t file_offset;
+
+    /* Whether the pages of a free extent were released, so that they read as zeros */
+    bool zeroed;
+
+    /* Next extent in the list of free extents */
+    LargeDescription* next;
 };
 
 /* Main class of memory management */
@@ -81,13 +161,13 @@ class MemoryManager
          * Allocate memory of size bytes. Returned address must be a multiple
          * of align if align > 0, otherwise it is default aligned.
          */
-        void* allocate(int size, int flags, int align);
+        void* allocate(size_t size, int flags, int align);
 
         /*
          * Attempt to reallocate memory in-place, or allocate a new
          * memory segment and copy values in the new address
          */
-        void* reallocate(void* address, int size, int flags);
+        void* reallocate(void* address, size_t size, int flags);
 
         /* 
          * Deallocate a segment of memory using the base address.
@@ -101,7 +181,146 @@ class MemoryManager
          */
         void dumpAllocationTable();
         void checkIntegrity();
+
+        /*
+         * Fill the current statistics of the heap. The numbers of
+         * allocations are counted since the previous call.
+         */
+        void takeStats(MemoryStats& stats);
+
+        /* Biggest allocation size that is served by slabs */
+        static const uint32_t SLAB_MAX_SIZE = 2048;
+
     private:
+        /* Number of slab size classes, see slabClass() */
+        static const int SLAB_CLASS_COUNT = MEMSTATS_NUMCLASSES;
+
+        /* Size of a slab, including its header */
+        static const uint32_t SLAB_SIZE = 64 * 1024;
+
+        /* Size of the regions of the shared memory file that slabs are carved from */
+        static const uint32_t SLAB_ARENA_SIZE = 1024 * 1024;
+
+        /* Maximum number of slab arenas. Above this, small allocations
+         * fall back to the bitmap heap */
+        static const int MAX_SLAB_ARENAS = 4096;
+
+        /*
+         * The block index is a radix tree over page numbers, with three
+         * levels of INDEX_BITS bits each, covering 48-bit addresses.
+         */
+        static const int INDEX_PAGE_SHIFT = 12;
+        static const int INDEX_BITS = 12;
+
+        /* Tags of the index entries that point to a slab arena or to the
+         * description of a large extent, instead of a memory block */
+        static const uintptr_t INDEX_SLAB_ARENA = 1;
+        static const uintptr_t INDEX_LARGE = 2;
+        static const uintptr_t INDEX_TAG_MASK = 3;
+
+        /* Allocations of at least this size get their own extent */
+        static const size_t LARGE_THRESHOLD = 128 * 1024;
+
+        /* Extents of at least this size can use transparent huge pages */
+        static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+        /* Address and size of the range reserved for the heap when
+         * config.memorymanager_fixed_base is set. The address is far from
+         * where the kernel places executables, libraries and mappings */
+        static const uintptr_t FIXED_BASE_ADDRESS = 0x200000000000;
+        static const off_t FIXED_BASE_RESERVED_SIZE = static_cast<off_t>(256) << 30;
+
+        /* Maximum number of thread caches. Threads above this allocate
+         * with the lock held */
+        static const int MAX_THREAD_CACHES = 256;
+
+        /*
+         * Per-thread cache of free objects for each size class, stored in
+         * the shared state. Objects in a cache are still counted as used by
+         * their slab.
+         */
+        struct ThreadCache
+        {
+            /* Linked lists of free objects, same layout as the slab free lists */
+            uint8_t* objects[SLAB_CLASS_COUNT];
+            uint32_t counts[SLAB_CLASS_COUNT];
+
+            /* Number of allocations and deallocations served by the cache.
+             * Only written by the owning thread */
+            uint64_t allocations;
+            uint64_t deallocations;
+
+            /* Id of the thread that uses the cache, or 0 if the cache is free.
+             * It is saved with the cache, so after loading a savestate each
+             * thread gets back the cache that it used when the state was saved */
+            pid_t owner;
+        };
+
+        /*
+         * Mutable state of the allocator. It is stored at the beginning of the
+         * shared memory file, so that a savestate restores it together with the
+         * blocks and slabs that it points to.
+         */
+        struct SharedState
+        {
+            /* Pointer to the first memory segment */
+            MemoryObjectDescription* fmod;
+
+            /* Pointer to the last used memory segment */
+            MemoryObjectDescription* lmod;
+
+            /* For each size class, list of slabs that have free objects */
+            SlabDescription* partial_slabs[SLAB_CLASS_COUNT];
+
+            /* List of empty slabs that can be reused by any size class */
+            SlabDescription* free_slabs;
+
+            /* Arena that new slabs are carved from, and the number of bytes already carved */
+            uint8_t* slab_arena;
+            uint32_t slab_arena_used;
+
+            /* Base addresses of all slab arenas */
+            uint8_t* slab_arenas[MAX_SLAB_ARENAS];
+            int slab_arena_count;
+
+            /*
+             * Root of the block index, mapping each page that we own to its memory
+             * block or slab arena. All nodes are stored in the shared memory file.
+             */
+            uintptr_t*** block_index;
+
+            /* List of free large extents */
+            LargeDescription* free_extents;
+
+            /* Caches of all threads, and the number of caches ever used */
+            ThreadCache caches[MAX_THREAD_CACHES];
+            int cache_count;
+
+            /* Statistics counters, updated with the lock held. Objects in
+             * thread caches are counted in slab_objects */
+            uint32_t slab_objects[SLAB_CLASS_COUNT];
+            uint64_t large_in_use;
+            uint32_t large_count;
+            uint64_t allocations;
+            uint64_t reallocations;
+            uint64_t deallocations;
+
+            /* Total numbers of allocations at the previous takeStats() call */
+            uint64_t last_allocations;
+            uint64_t last_reallocations;
+            uint64_t last_deallocations;
+        };
+
+        /* Cache of the current thread, or nullptr if not created yet. It must
+         * only be used if it is still owned by the thread, because loading a
+         * savestate restores the owners of all caches */
+        static thread_local ThreadCache* thread_cache;
+
+        /* Id of the current thread, or 0 if not known yet */
+        static thread_local pid_t thread_id;
+
+        /* Release the cache of an exiting thread */
+        static void threadCacheDestructor(void* cache);
 
         /*
          * Warning: we must *not* enter default value for parameters,
@@ -111,12 +330,6 @@ class MemoryManager
          * as globals are intialized early enough.
          */
 
-        /* Pointer to the first memory segment */
-        MemoryObjectDescription* fmod;
-
-        /* Pointer to the first memory segment */
-        MemoryObjectDescription* lmod;
-
         /* Base memory size we can allocate with mmap. Usually the page size */
         uint32_t allocation_granularity;
 
@@ -138,18 +351,37 @@ class MemoryManager
         /* Our allocation must be tread-safe */
         std::atomic_flag allocation_lock;
 
+        void lock() {while (allocation_lock.test_and_set() == true) {}}
+        void unlock() {allocation_lock.clear();}
+
         /* File descriptor of the mmap-ed file */
         int fd;
 
-        /* Current offset in the mmap-ed file, from where we can allocate more memory */
+        /* Current offset in the mmap-ed file, from where we can allocate more memory.
+         * It is not part of the shared state: a savestate does not shrink the file
+         * nor remove our mappings, so new regions must still go after all of them */
         off_t file_size;
 
+        /* Start of the reserved heap range, or nullptr if the file is mapped
+         * wherever the kernel wants. Each part of the file is then mapped at
+         * the same offset from this address */
+        uint8_t* fixed_base;
+
+        /* Size of the SlabDescription struct, aligned with global_align */
+        int size_of_slab;
+
+        /* State stored at the start of the shared memory file */
+        SharedState* state;
+
+        /* Key used to release the cache when a thread exits */
+        pthread_key_t cache_key;
+
         /*
          * Internal allocation functions
          */
 
         /* Thread unsafe allocate */
-        uint8_t* allocateUnprotected(uint32_t size, int flags, int align);
+        uint8_t* allocateUnprotected(size_t size, int flags, int align);
 
         /* Tries to allocate in current memory. Returns nullptr if not possible */
         uint8_t* allocateInExistingBlock(uint32_t size, int flags, int align);
@@ -160,8 +392,72 @@ class MemoryManager
          */
         void newBlock(uint32_t size, int flags);
 
+        /* Extend the shared memory file and map the new part of size bytes */
+        uint8_t* mapNewRegion(size_t size, int flags);
+
+        /* Give back a region returned by mapNewRegion that could not be
+         * used, mapped at the given offset of the file */
+        void unmapRegion(uint8_t* addr, size_t size, off_t offset);
+
+        /* Allocate a small object in a slab. Returns nullptr if not possible */
+        uint8_t* allocateInSlab(uint32_t size, int flags);
+
+        /* Get a slab for the given size class, and insert it into the class list */
+        SlabDescription* newSlab(int size_class);
+
+        /* Register all pages of a mapped region as belonging to owner */
+        bool indexRegion(uint8_t* addr, size_t size, uintptr_t owner);
+
+        /* Return the owner of the page containing address, or 0 */
+        uintptr_t lookupIndex(uint8_t* address);
+
+        /* Return the slab containing the address, or nullptr if the address
+         * was not allocated by a slab */
+        SlabDescription* findSlab(uint8_t* address);
+
+        /* Return the memory block containing the address, or nullptr */
+        MemoryObjectDescription* findBlock(uint8_t* address);
+
+        /* Return the description of the large allocation starting at address, or nullptr */
+        LargeDescription* findLarge(uint8_t* address);
+
+        /* Allocate, resize or free a large allocation in its own extent */
+        uint8_t* allocateLarge(size_t size, int flags);
+        uint8_t* reallocateLarge(LargeDescription* large, size_t size, int flags);
+        void deallocateLarge(LargeDescription* large);
+
+        /* Size of the extent reserved for a large allocation of the given size */
+        size_t largeCapacity(size_t size);
+
+        /* Give back to the system the whole pages inside a range of memory
+         * that is not used anymore. Returns false on error */
+        bool releasePages(uint8_t* addr, size_t size);
+
+        /* Release the whole free pages around the blocks [first, last) of a
+         * memory block, which were just freed */
+        void releaseFreeBlocks(MemoryObjectDescription* mod, uint32_t first, uint32_t last);
+
+        /* Free an object of a slab */
+        void deallocateInSlab(SlabDescription* slab, uint8_t* address);
+
+        /* Insert or remove a slab from the list of slabs with free objects */
+        void linkSlab(SlabDescription* slab);
+        void unlinkSlab(SlabDescription* slab);
+
+        /* Allocate and free small objects using the thread cache, without
+         * taking the lock in most cases */
+        uint8_t* allocateCached(uint32_t size, int flags);
+        bool deallocateCached(uint8_t* address);
+
+        /* Get the cache owned by the current thread, or a free one */
+        ThreadCache* newThreadCache();
+
+        /* Thread unsafe transfer of objects between a cache and the slabs */
+        void refillCache(ThreadCache* cache, int size_class);
+        void drainCache(ThreadCache* cache, int size_class, uint32_t count);
+
         /* Thread unsafe reallocate */
-        uint8_t* reallocateUnprotected(uint8_t* address, uint32_t size, int flags);
+        uint8_t* reallocateUnprotected(uint8_t* address, size_t size, int flags);
 
         /* Thread unsafe deallocate */
         bool deallocateUnprotected(uint8_t* address);
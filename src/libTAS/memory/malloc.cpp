@@ -20,10 +20,12 @@
 #include "malloc.h"
 #include "../logging.h"
 #include "MemoryManager.h"
+#include "AllocTrace.h"
 #include "../dlhook.h"
 #include "../ThreadState.h"
 #include "../backtrace.h"
 #include "../../shared/Config.h"
+#include <unistd.h> // getpagesize()
 
 namespace orig {
     static void *(*malloc) (size_t size) throw();
@@ -48,6 +50,7 @@ void *malloc (size_t size) throw()
         LINK_NAMESPACE(malloc, nullptr);
         addr = orig::malloc(size);
     }
+    traceAllocation(ALLOCTRACE_MALLOC, size, addr, 0);
     debuglogstdio(LCF_MEMORY, "  returns addr %p", addr);
     return addr;
 }
@@ -61,8 +64,15 @@ void *calloc (size_t nmemb, size_t size) throw()
 {
     debuglogstdio(LCF_MEMORY, "%s call with size %d", __func__, size);
     void* addr;
-    if (config.custom_memorymanager && !threadState.isNative())
-        addr = memorymanager.allocate(nmemb * size, MemoryManager::ALLOC_WRITE | MemoryManager::ALLOC_ZEROINIT, 0);
+    size_t bytes;
+    if (config.custom_memorymanager && !threadState.isNative()) {
+        /* The memory manager only clears the memory that was used before */
+        if (__builtin_mul_overflow(nmemb, size, &bytes)) {
+            errno = ENOMEM;
+            return nullptr;
+        }
+        addr = memorymanager.allocate(bytes, MemoryManager::ALLOC_WRITE | MemoryManager::ALLOC_ZEROINIT, 0);
+    }
     else {
         /*
          * We must add a hack here, because to access to the original
@@ -81,12 +91,13 @@ void *calloc (size_t nmemb, size_t size) throw()
             dlhook_init();
             dlenter();
             /* calloc is called below, and returns NULL */
-            orig::calloc = reinterpret_cast<void*(*)(size_t, size_t)>(dlsym(RTLD_NEXT, "calloc"));
+            orig::calloc = reinterpret_cast<decltype(orig::calloc)>(dlsym(RTLD_NEXT, "calloc"));
             dlleave();
 
         }
         addr = orig::calloc(nmemb, size);
     }
+    traceAllocation(ALLOCTRACE_CALLOC, nmemb * size, addr, 0);
     debuglogstdio(LCF_MEMORY, "  returns addr %p", addr);
     return addr;
 }
@@ -101,6 +112,7 @@ void *realloc (void *ptr, size_t size) throw()
         LINK_NAMESPACE(realloc, nullptr);
         addr = orig::realloc(ptr, size);
     }
+    traceReallocation(ptr, size, addr);
     debuglogstdio(LCF_MEMORY, "  returns addr %p", addr);
     return addr;
 }
@@ -117,6 +129,7 @@ void *valloc (size_t size) throw()
         LINK_NAMESPACE(valloc, nullptr);
         addr = orig::valloc(size);
     }
+    traceAllocation(ALLOCTRACE_MEMALIGN, size, addr, getpagesize());
     debuglogstdio(LCF_MEMORY, "  returns addr %p", addr);
     return addr;
 }
@@ -133,6 +146,7 @@ void *pvalloc (size_t size) throw()
         LINK_NAMESPACE(pvalloc, nullptr);
         addr = orig::pvalloc(size);
     }
+    traceAllocation(ALLOCTRACE_MEMALIGN, size, addr, getpagesize());
     debuglogstdio(LCF_MEMORY, "  returns addr %p", addr);
     return addr;
 }
@@ -152,6 +166,8 @@ int posix_memalign (void **memptr, size_t alignment, size_t size) throw()
         LINK_NAMESPACE(posix_memalign, nullptr);
         ret = orig::posix_memalign (memptr, alignment, size);
     }
+    if (ret == 0)
+        traceAllocation(ALLOCTRACE_MEMALIGN, size, *memptr, alignment);
     debuglogstdio(LCF_MEMORY, "  returns addr %p", *memptr);
     return ret;
 }
@@ -167,6 +183,7 @@ void *aligned_alloc (size_t alignment, size_t size) throw()
         LINK_NAMESPACE(aligned_alloc, nullptr);
         addr = orig::aligned_alloc(alignment, size);
     }
+    traceAllocation(ALLOCTRACE_MEMALIGN, size, addr, alignment);
     debuglogstdio(LCF_MEMORY, "  returns addr %p", addr);
     return addr;
 }
@@ -182,6 +199,7 @@ void *memalign (size_t alignment, size_t size) throw()
         LINK_NAMESPACE(memalign, nullptr);
         addr = orig::memalign(alignment, size);
     }
+    traceAllocation(ALLOCTRACE_MEMALIGN, size, addr, alignment);
     debuglogstdio(LCF_MEMORY, "  returns addr %p", addr);
     return addr;
 }
@@ -189,6 +207,7 @@ void *memalign (size_t alignment, size_t size) throw()
 void free (void *ptr) throw()
 {
     debuglogstdio(LCF_MEMORY, "%s call with ptr %p", __func__, ptr);
+    traceFree(ptr);
     //if (config.custom_memorymanager && !threadState.isNative())
     bool res = true;
     if (config.custom_memorymanager)
@@ -23,6 +23,7 @@
 #include "../logging.h"
 #include "../hook.h"
 #include <sstream>
+#include <iomanip>
 #include <X11/Xlib.h> // For the KeySym type
 
 const char* fontpath = "/home/clement/libTAS/src/external/GenBkBasR.ttf";
@@ -136,5 +137,24 @@ void RenderHUD::renderInputs(AllInputs& ai)
     renderText(text.c_str(), fg_color, bg_color, 2, 400);
 }
 
+void RenderHUD::renderMemory(const MemoryStats& stats)
+{
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1);
+
+    /* Heap usage in MB, fragmentation and allocation rate */
+    double used = stats.bytesInUse / (1024.0 * 1024.0);
+    double allocated = stats.bytesAllocated / (1024.0 * 1024.0);
+    oss << "Heap " << used << "/" << allocated << " MB";
+    if (stats.bytesAllocated)
+        oss << " (" << 100.0 * (1.0 - static_cast<double>(stats.bytesInUse) / stats.bytesAllocated) << "% frag)";
+    oss << " +" << stats.allocations << " -" << stats.deallocations;
+
+    Color fg_color = {255, 255, 255, 0};
+    Color bg_color = {0, 0, 0, 0};
+    std::string text = oss.str();
+    renderText(text.c_str(), fg_color, bg_color, 2, 30);
+}
+
 #endif
 
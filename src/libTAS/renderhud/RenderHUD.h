@@ -26,6 +26,7 @@
 #include "sdl_ttf.h"
 #include "SurfaceARGB.h"
 #include "../../shared/AllInputs.h"
+#include "../../shared/MemoryStats.h"
 #include <memory>
 
 /* This class handles the display of some text over the game screen (HUD).
@@ -70,6 +71,9 @@ class RenderHUD
         /* Display the inputs on screen */
         void renderInputs(AllInputs& ai);
 
+        /* Display the statistics of the memory manager on screen */
+        void renderMemory(const MemoryStats& stats);
+
     protected:
         /* Create a texture from a text, using colors for the text and the outline */
         std::unique_ptr<SurfaceARGB> createTextSurface(const char* text, Color fg_color, Color bg_color);
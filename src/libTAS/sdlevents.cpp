@@ -30,6 +30,9 @@ namespace orig {
     static int (*SDL_PeepEvents)(void *events, int numevents, SDL_eventaction action, Uint32 minType, Uint32 maxType);
 }
 
+/* Number of events gathered at once from the SDL queue */
+#define NATIVE_EVENTS_BATCH 128
+
 void pushNativeEvents(void)
 {
     orig::SDL_PumpEvents();
@@ -38,19 +41,42 @@ void pushNativeEvents(void)
      * as it is the native function of getting events.
      * i.e. all other functions call this function internally.
      */
+    /* Events are gathered by batches. In each batch, the events that are
+     * passed to the game are moved at the beginning of the array, then
+     * inserted together in our queue.
+     */
     if (SDLver == 1) {
-        SDL1::SDL_Event ev;
-        while (orig::SDL_PeepEvents(&ev, 1, SDL_GETEVENT, SDL1::SDL_ALLEVENTS, 0)) {
-            if (! filterSDL1Event(&ev))
-                sdlEventQueue.insert(&ev);
-        }
+        SDL1::SDL_Event events[NATIVE_EVENTS_BATCH];
+        int num;
+        do {
+            num = orig::SDL_PeepEvents(events, NATIVE_EVENTS_BATCH, SDL_GETEVENT, SDL1::SDL_ALLEVENTS, 0);
+            int kept = 0;
+            for (int i = 0; i < num; i++) {
+                if (! filterSDL1Event(&events[i])) {
+                    if (kept != i)
+                        events[kept] = events[i];
+                    kept++;
+                }
+            }
+            sdlEventQueue.insert(events, kept);
+        } while (num == NATIVE_EVENTS_BATCH);
     }
 
     if (SDLver == 2) {
-        SDL_Event ev;
-        while (orig::SDL_PeepEvents(&ev, 1, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT))
-            if (! filterSDL2Event(&ev))
-                sdlEventQueue.insert(&ev);
+        SDL_Event events[NATIVE_EVENTS_BATCH];
+        int num;
+        do {
+            num = orig::SDL_PeepEvents(events, NATIVE_EVENTS_BATCH, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+            int kept = 0;
+            for (int i = 0; i < num; i++) {
+                if (! filterSDL2Event(&events[i])) {
+                    if (kept != i)
+                        events[kept] = events[i];
+                    kept++;
+                }
+            }
+            sdlEventQueue.insert(events, kept);
+        } while (num == NATIVE_EVENTS_BATCH);
     }
 }
 
@@ -261,10 +287,10 @@ Uint8 SDL_EventState(Uint32 type, int state)
     int previousState = sdlEventQueue.isEnabled(type) ? SDL_ENABLE : SDL_DISABLE;
     switch (state) {
         case SDL_ENABLE:
-            sdlEventQueue.enable(state);
+            sdlEventQueue.enable(type);
             return previousState;
         case SDL_DISABLE:
-            sdlEventQueue.disable(state);
+            sdlEventQueue.disable(type);
             return previousState;
         case SDL_QUERY:
             return previousState;
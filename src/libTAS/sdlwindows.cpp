@@ -20,8 +20,6 @@
 #include "sdlwindows.h"
 #include "hook.h"
 #include "logging.h"
-#include "socket.h"
-#include "../shared/messages.h"
 #include "../shared/tasflags.h"
 #include "frame.h"
 //#include "libTAS.h"
@@ -83,8 +81,7 @@ namespace orig {
      */
     if (!gw_sent) {
         Window w = 0;
-        sendMessage(MSGB_WINDOW_ID);
-        sendData(&w, sizeof(Window));
+        sendWindowId(w);
         gw_sent = 1;
         debuglog(LCF_SDL, "Send dummy X11 window id.");
     }
@@ -118,8 +115,7 @@ int sendXid(void)
             Window xgw = info.info.x11.window;
 
             /* Send the X Window identifier to the program */
-            sendMessage(MSGB_WINDOW_ID);
-            sendData(&xgw, sizeof(Window));
+            sendWindowId(xgw);
             gw_sent = true;
             debuglog(LCF_SDL, "Send X11 window id: ", xgw);
         }
@@ -439,8 +435,7 @@ void updateTitle(float fps, float lfps)
      */
     if (!gw_sent) {
         Window w = 0;
-        sendMessage(MSGB_WINDOW_ID);
-        sendData(&w, sizeof(Window));
+        sendWindowId(w);
         gw_sent = 1;
         debuglog(LCF_SDL, "Send dummy X11 window id.");
     }
@@ -500,8 +495,7 @@ void glXSwapBuffers( Display *dpy, XID drawable )
     debuglog(LCF_FRAME | LCF_WINDOW, __func__, " call.");
 
     if (!gw_sent) {
-        sendMessage(MSGB_WINDOW_ID);
-        sendData(&drawable, sizeof(Window));
+        sendWindowId(drawable);
         gw_sent = 1;
         debuglog(LCF_SDL, "Sent X11 window id: ", drawable);
     }
@@ -24,9 +24,13 @@
 #include "backtrace.h"
 #include "ThreadState.h"
 #include "hook.h"
+#include "../shared/tasflags.h"
 
 namespace orig {
     int (*nanosleep) (const struct timespec *requested_time, struct timespec *remaining);
+    int (*clock_nanosleep) (clockid_t clock_id, int flags,
+			    const struct timespec *req,
+			    struct timespec *rem);
 }
 
 /* Override */ void SDL_Delay(unsigned int sleep)
@@ -45,6 +49,10 @@ namespace orig {
      */
     if (sleep && mainT && !threadState.isNative()) {
         detTimer.addDelay(ts);
+
+        /* Don't even yield in turbo mode */
+        if (tasflags.turbo)
+            return;
         ts.tv_sec = 0;
         ts.tv_nsec = 0;
     }
@@ -68,6 +76,10 @@ namespace orig {
      */
     if (usec && mainT && !threadState.isNative()) {
         detTimer.addDelay(ts);
+
+        /* Don't even yield in turbo mode */
+        if (tasflags.turbo)
+            return 0;
         ts.tv_sec = 0;
         ts.tv_nsec = 0;
     }
@@ -88,6 +100,10 @@ namespace orig {
      */
     if (mainT && !threadState.isNative()) {
         detTimer.addDelay(*requested_time);
+
+        /* Don't even yield in turbo mode */
+        if (tasflags.turbo)
+            return 0;
         struct timespec owntime = {0, 0};
         return orig::nanosleep(&owntime, remaining);
     }
@@ -120,6 +136,10 @@ namespace orig {
      */
     if (mainT && !threadState.isNative()) {
         detTimer.addDelay(sleeptime);
+
+        /* Don't even yield in turbo mode */
+        if (tasflags.turbo)
+            return 0;
         struct timespec owntime = {0, 0};
         return orig::nanosleep(&owntime, rem);
     }
@@ -130,5 +150,6 @@ namespace orig {
 void link_sleep(void)
 {
     LINK_NAMESPACE(nanosleep, nullptr);
+    LINK_NAMESPACE(clock_nanosleep, nullptr);
 }
 
@@ -28,6 +28,11 @@
 namespace orig {
     /* We need at least one function to make a sleep */
     extern int (*nanosleep) (const struct timespec *requested_time, struct timespec *remaining);
+
+    /* Used for absolute sleeps when pacing frames */
+    extern int (*clock_nanosleep) (clockid_t clock_id, int flags,
+			    const struct timespec *req,
+			    struct timespec *rem);
 }
 
 /* Sleep USECONDS microseconds, or until a signal arrives that is not blocked
@@ -25,28 +25,39 @@
 #include <unistd.h>
 #include "logging.h"
 #include <sys/un.h>
-
-#define SOCKET_FILENAME "/tmp/libTAS.socket"
+#include "../shared/MessageSocket.h"
+#include "../shared/instance.h"
+#include <string.h>
 
 /* Socket to communicate to the program */
 static int socket_fd = 0;
 
+/* Message framing over the socket. It is allocated when connecting,
+ * because our constructor may be called before the static initialization
+ * of this file.
+ */
+static MessageSocket* msgSocket = nullptr;
+
 bool initSocket(void)
 {
     /* Check if socket file already exists. If so, it is probably because
      * the link is already done in another process of the game.
      * In this case, we just return immediately.
      */
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    instanceSocketPath(addr.sun_path, sizeof(addr.sun_path));
+
     struct stat st;
-    int result = stat(SOCKET_FILENAME, &st);
+    int result = stat(addr.sun_path, &st);
     if (result == 0)
         return false;
 
     /* Connect using a Unix socket */
-    if (!unlink(SOCKET_FILENAME))
+    if (!unlink(addr.sun_path))
         debuglog(LCF_SOCKET, "Removed stall socket.");
 
-    const struct sockaddr_un addr = { AF_UNIX, SOCKET_FILENAME };
     const int tmp_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (bind(tmp_fd, reinterpret_cast<const struct sockaddr*>(&addr), sizeof(struct sockaddr_un)))
     {
@@ -71,29 +82,54 @@ bool initSocket(void)
     debuglog(LCF_SOCKET, "Client connected.");
 
     close(tmp_fd);
-    //unlink(SOCKET_FILENAME);
+    //unlink(addr.sun_path);
+
+    msgSocket = new MessageSocket;
+    msgSocket->setFd(socket_fd);
 
     return true;
 }
 
 void closeSocket(void)
 {
+    if (msgSocket)
+        flushMessages();
     close(socket_fd);
+}
 
+void sendMessage(int message)
+{
+    msgSocket->sendMessage(message);
 }
 
-void sendData(void* elem, size_t size)
+void sendData(const void* elem, size_t size)
 {
-    send(socket_fd, elem, size, 0);
+    msgSocket->sendData(elem, size);
 }
 
-void sendMessage(int message)
+void flushMessages(void)
 {
-    sendData(&message, sizeof(int));
+    if (!msgSocket->flush())
+        debuglog(LCF_ERROR | LCF_SOCKET, "Could not send messages to the program");
+}
+
+int receiveMessage(void)
+{
+    int message;
+    if (!msgSocket->receiveMessage(message)) {
+        debuglog(LCF_ERROR | LCF_SOCKET, "Could not receive a message from the program");
+        return -1;
+    }
+    return message;
 }
 
 void receiveData(void* elem, size_t size)
 {
-    recv(socket_fd, elem, size, 0);
+    if (!msgSocket->receiveData(elem, size))
+        debuglog(LCF_ERROR | LCF_SOCKET, "Received message is too short");
 }
 
+bool isDataPending(void)
+{
+    return msgSocket->isPending();
+}
@@ -28,16 +28,33 @@ bool initSocket(void);
 /* Close the socket connection */
 void closeSocket(void);
 
-/* Send data over the socket. Data is stored at the beginning of
- * pointer elem, and has the specified size in bytes.
+/* Queue a message to be sent over the socket. Messages are not sent
+ * immediately, but all at once when calling flushMessages() or
+ * when waiting for a message from linTAS.
+ * The queue is not thread-safe: apart from the initialization and the
+ * exit of the game, messages are only sent from the frame boundary.
  */
-void sendData(void* elem, size_t size);
-
-/* Helper function to send a message over the socket */
 void sendMessage(int message);
 
-/* Receive data from the socket. Same arguments as sendData() */
+/* Append data to the last queued message. Data is stored at the beginning
+ * of pointer elem, and has the specified size in bytes.
+ */
+void sendData(const void* elem, size_t size);
+
+/* Send all queued messages */
+void flushMessages(void);
+
+/* Receive the next message from the socket, and return its identifier,
+ * or -1 if the connection is broken.
+ */
+int receiveMessage(void);
+
+/* Receive data from the payload of the last received message.
+ * Same arguments as sendData()
+ */
 void receiveData(void* elem, size_t size);
 
-#endif
+/* Check, without blocking, if a message can be received from the socket */
+bool isDataPending(void);
 
+#endif
@@ -21,6 +21,7 @@
 #include "logging.h"
 #include <errno.h>
 #include <unistd.h>
+#include <atomic>
 
 /* Original function pointers */
 namespace orig {
@@ -42,6 +43,13 @@ namespace orig {
 /* We keep the identifier of the main thread */
 pthread_t mainThread = 0;
 
+/* Each thread caches the result of isMainThread(), which is invalidated
+ * when the main thread is set. The generation starts at 1 so that the
+ * zero-initialized cache is invalid. */
+static std::atomic<unsigned int> mainThreadGeneration(1);
+static thread_local unsigned int cachedMainGeneration = 0;
+static thread_local bool cachedIsMainThread = false;
+
 /* Get the current thread id */
 pthread_t getThreadId(void)
 {
@@ -56,8 +64,10 @@ void setMainThread(void)
     if (mainThread != 0)
         /* Main thread was already set */
         return;
-    if (orig::pthread_self != nullptr)
+    if (orig::pthread_self != nullptr) {
         mainThread = orig::pthread_self();
+        mainThreadGeneration.fetch_add(1, std::memory_order_release);
+    }
 }
 
 /* 
@@ -66,8 +76,17 @@ void setMainThread(void)
  */
 int isMainThread(void)
 {
-    if (orig::pthread_self != nullptr)
-        return (orig::pthread_self() == mainThread);
+    /* This is called by every time hook, so avoid calling pthread_self
+     * through a function pointer each time */
+    unsigned int generation = mainThreadGeneration.load(std::memory_order_acquire);
+    if (cachedMainGeneration == generation)
+        return cachedIsMainThread;
+
+    if (orig::pthread_self != nullptr) {
+        cachedIsMainThread = (orig::pthread_self() == mainThread);
+        cachedMainGeneration = generation;
+        return cachedIsMainThread;
+    }
 
     /* If pthread library is not loaded, it is likely that the game is single threaded */
     return 1;
@@ -21,30 +21,166 @@
 #include "logging.h"
 #include "DeterministicTimer.h"
 #include "ThreadState.h"
-#include "hook.h"
+#include "TimeHolder.h"
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <mutex>
 
-namespace orig {
-    static SDL_TimerID (*SDL_AddTimer)(Uint32 interval, SDL_NewTimerCallback callback, void *param);
-    static SDL_bool (*SDL_RemoveTimer)(SDL_TimerID id);
+/* An emulated SDL timer */
+struct EmulatedTimer {
+    /* Deterministic time at which the timer expires */
+    TimeHolder deadline;
+
+    /* Insertion order, to fire timers with the same deadline deterministically */
+    unsigned long order;
+
+    Uint32 interval;
+    SDL_NewTimerCallback callback;
+    void *param;
+    SDL_TimerID id;
+};
+
+/* Comparison so that the heap has the earliest timer on top */
+static bool laterTimer(const EmulatedTimer& a, const EmulatedTimer& b)
+{
+    if (a.deadline.tv_sec != b.deadline.tv_sec)
+        return a.deadline.tv_sec > b.deadline.tv_sec;
+    if (a.deadline.tv_nsec != b.deadline.tv_nsec)
+        return a.deadline.tv_nsec > b.deadline.tv_nsec;
+    return a.order > b.order;
+}
+
+/* Min-heap of scheduled timers. Removed timers stay in the heap and are
+ * discarded when they reach the top, only active ids are valid. The heap
+ * is rebuilt when it holds more removed timers than active ones. */
+static std::vector<EmulatedTimer> timerHeap;
+static std::set<SDL_TimerID> activeTimers;
+static SDL_TimerID nextTimerId = 1;
+static unsigned long nextTimerOrder = 0;
+static std::mutex timerMutex;
+
+/* Identifier of the SDL 1.2 timer set with SDL_SetTimer */
+static SDL_TimerID setTimerId = 0;
+
+/* Must be called with timerMutex held */
+static void scheduleTimer(EmulatedTimer& timer, const TimeHolder& start)
+{
+    struct timespec delay = {timer.interval / 1000, (timer.interval % 1000) * 1000000};
+    timer.deadline = start;
+    timer.deadline += delay;
+    timer.order = nextTimerOrder++;
+    timerHeap.push_back(timer);
+    std::push_heap(timerHeap.begin(), timerHeap.end(), laterTimer);
 }
 
 /* Override */ SDL_TimerID SDL_AddTimer(Uint32 interval, SDL_NewTimerCallback callback, void *param)
 {
-    debuglog(LCF_TIMEFUNC | LCF_SDL | LCF_TODO, "Add SDL Timer with call after ", interval, " ms");
-    return orig::SDL_AddTimer(interval, callback, param);
+    debuglog(LCF_TIMEFUNC | LCF_SDL, "Add SDL Timer with call after ", interval, " ms");
+
+    TimeHolder now;
+    now = detTimer.getTicks(TIMETYPE_UNTRACKED);
+
+    std::lock_guard<std::mutex> lock(timerMutex);
+    EmulatedTimer timer;
+    timer.interval = interval;
+    timer.callback = callback;
+    timer.param = param;
+    timer.id = nextTimerId++;
+    activeTimers.insert(timer.id);
+    scheduleTimer(timer, now);
+    return timer.id;
 }
 
 /* Override */ SDL_bool SDL_RemoveTimer(SDL_TimerID id)
 {
-    debuglog(LCF_TIMEFUNC | LCF_SDL | LCF_TODO, "Remove SDL Timer.");
-    return orig::SDL_RemoveTimer(id);
+    debuglog(LCF_TIMEFUNC | LCF_SDL, "Remove SDL Timer.");
+
+    std::lock_guard<std::mutex> lock(timerMutex);
+    if (!activeTimers.erase(id))
+        return SDL_FALSE;
+
+    /* Drop the removed timers, so that a game which keeps adding and
+     * removing timers with a long interval does not grow the heap */
+    if (timerHeap.size() > 2 * activeTimers.size()) {
+        timerHeap.erase(std::remove_if(timerHeap.begin(), timerHeap.end(),
+            [](const EmulatedTimer& timer) {
+                return activeTimers.find(timer.id) == activeTimers.end();
+            }), timerHeap.end());
+        std::make_heap(timerHeap.begin(), timerHeap.end(), laterTimer);
+    }
+    return SDL_TRUE;
 }
 
-void link_sdltimer(void)
+/* Call the SDL 1.2 timer callback, stored in the param pointer */
+static Uint32 setTimerCallback(Uint32 interval, void *param)
 {
-    LINK_NAMESPACE_SDLX(SDL_AddTimer);
-    LINK_NAMESPACE_SDLX(SDL_RemoveTimer);
-    /* TODO: Add SDL 1.2 SetTimer */
+    SDL_TimerCallback callback = reinterpret_cast<SDL_TimerCallback>(param);
+    return callback(interval);
 }
 
+/* Override */ int SDL_SetTimer(Uint32 interval, SDL_TimerCallback callback)
+{
+    debuglog(LCF_TIMEFUNC | LCF_SDL, "Set SDL Timer with call after ", interval, " ms");
+
+    /* There is only one such timer, replace the previous one */
+    if (setTimerId != 0) {
+        SDL_RemoveTimer(setTimerId);
+        setTimerId = 0;
+    }
+
+    if (interval && callback)
+        setTimerId = SDL_AddTimer(interval, setTimerCallback, reinterpret_cast<void*>(callback));
 
+    return 0;
+}
+
+void fireSDLTimers(struct timespec ticks)
+{
+    /* A callback may go through a frame boundary, which runs the timers
+     * again. The timers that expire there are left to the next frame. */
+    static thread_local bool firing = false;
+    if (firing)
+        return;
+    firing = true;
+
+    TimeHolder now;
+    now = ticks;
+
+    std::unique_lock<std::mutex> lock(timerMutex);
+
+    while (!timerHeap.empty()) {
+        EmulatedTimer timer = timerHeap.front();
+        bool removed = (activeTimers.find(timer.id) == activeTimers.end());
+
+        /* Removed timers on top are dropped even if they did not expire */
+        if (!removed && (timer.deadline > now))
+            break;
+
+        std::pop_heap(timerHeap.begin(), timerHeap.end(), laterTimer);
+        timerHeap.pop_back();
+
+        if (removed)
+            continue;
+
+        debuglog(LCF_TIMEFUNC | LCF_SDL, "Fire SDL Timer ", timer.id);
+
+        /* The callback is game code, which may add or remove timers */
+        lock.unlock();
+        Uint32 interval = timer.callback(timer.interval, timer.param);
+        lock.lock();
+
+        /* A zero interval cancels the timer */
+        if (interval == 0) {
+            activeTimers.erase(timer.id);
+            continue;
+        }
+
+        if (activeTimers.find(timer.id) != activeTimers.end()) {
+            timer.interval = interval;
+            scheduleTimer(timer, timer.deadline);
+        }
+    }
+
+    firing = false;
+}
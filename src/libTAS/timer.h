@@ -28,6 +28,14 @@
 typedef int SDL_TimerID;
 typedef Uint32 (*SDL_NewTimerCallback)(Uint32 interval, void *param);
 
+/* SDL 1.2 single timer callback */
+typedef Uint32 (*SDL_TimerCallback)(Uint32 interval);
+
+/* SDL timers are not run by the real SDL timer thread, but emulated using
+ * the deterministic timer. Their callbacks are called by the main thread
+ * when entering a frame boundary, in order of expiration.
+ */
+
 /**
  * \brief Add a new timer to the pool of timers already running.
  *
@@ -44,6 +52,16 @@ OVERRIDE SDL_TimerID SDL_AddTimer(Uint32 interval, SDL_NewTimerCallback callback
  */
 OVERRIDE SDL_bool SDL_RemoveTimer(SDL_TimerID id);
 
-void link_sdltimer(void);
+/**
+ * Set a callback to run after the specified number of milliseconds has
+ * elapsed (SDL 1.2 only). Passing a zero interval or a NULL callback
+ * cancels the current timer.
+ */
+OVERRIDE int SDL_SetTimer(Uint32 interval, SDL_TimerCallback callback);
+
+/* Call the callbacks of all the timers that expired at the given
+ * deterministic time, and schedule them again if needed. This is called
+ * after each frame boundary, once the frame mutex is released. */
+void fireSDLTimers(struct timespec ticks);
 
 #endif
@@ -0,0 +1,68 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FrameProfile.h"
+#include <algorithm>
+#include <cstdio>
+
+void FrameProfile::add(const FrameTimings& timings)
+{
+    samples.push_back(timings);
+}
+
+/* Print the distribution of a phase, in microseconds */
+static void printPhase(const char* name, std::vector<uint64_t>& values)
+{
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    printf("  %-10s %10.1f %10.1f %10.1f\n", name,
+            values[n / 2] / 1000.0,
+            values[(n * 99) / 100] / 1000.0,
+            values[n - 1] / 1000.0);
+}
+
+void FrameProfile::print()
+{
+    if (samples.empty())
+        return;
+
+    printf("Frame boundary timings over %zu frames, in us:\n", samples.size());
+    printf("  %-10s %10s %10s %10s\n", "phase", "p50", "p99", "max");
+
+    std::vector<uint64_t> values(samples.size());
+
+    /* List of phases with their offset in FrameTimings */
+    static const struct {
+        const char* name;
+        uint64_t FrameTimings::* field;
+    } phases[] = {
+        {"timer", &FrameTimings::timer},
+        {"draw", &FrameTimings::draw},
+        {"ipc wait", &FrameTimings::ipc_wait},
+        {"commands", &FrameTimings::commands},
+        {"events", &FrameTimings::events},
+        {"total", &FrameTimings::total},
+    };
+
+    for (auto& phase : phases) {
+        for (size_t i = 0; i < samples.size(); i++)
+            values[i] = samples[i].*phase.field;
+        printPhase(phase.name, values);
+    }
+}
@@ -0,0 +1,41 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LINTAS_FRAMEPROFILE_H_INCLUDED
+#define LINTAS_FRAMEPROFILE_H_INCLUDED
+
+#include "../shared/FrameTimings.h"
+#include <vector>
+
+/* Collect the frame boundary timings sent by a game running with a
+ * profiling build of libTAS, and print their distribution.
+ */
+class FrameProfile {
+    public:
+        void add(const FrameTimings& timings);
+
+        /* Print the p50, p99 and max of each phase. Does nothing if
+         * no timing was received. */
+        void print();
+
+    private:
+        std::vector<FrameTimings> samples;
+};
+
+#endif
@@ -0,0 +1,74 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MemoryStatsLog.h"
+#include <cstring>
+
+MemoryStatsLog::~MemoryStatsLog()
+{
+    close();
+}
+
+bool MemoryStatsLog::open(const char* filename)
+{
+    if (strcmp(filename, "-") == 0)
+        file = stdout;
+    else
+        file = fopen(filename, "w");
+
+    if (!file)
+        return false;
+
+    fprintf(file, "frame,bytes_in_use,bytes_allocated,fragmentation,heap_blocks,slab_arenas,large_extents");
+    fprintf(file, ",allocations,reallocations,deallocations");
+    for (int i = 0; i < MEMSTATS_NUMCLASSES; i++)
+        fprintf(file, ",class_%d", i);
+    fprintf(file, "\n");
+    return true;
+}
+
+void MemoryStatsLog::write(const MemoryStats& stats)
+{
+    if (!file)
+        return;
+
+    double fragmentation = 0;
+    if (stats.bytesAllocated)
+        fragmentation = 1.0 - static_cast<double>(stats.bytesInUse) / stats.bytesAllocated;
+
+    fprintf(file, "%lu,%llu,%llu,%.3f,%u,%u,%u", stats.frame,
+            static_cast<unsigned long long>(stats.bytesInUse),
+            static_cast<unsigned long long>(stats.bytesAllocated), fragmentation,
+            stats.heapBlocks, stats.slabArenas, stats.largeExtents);
+    fprintf(file, ",%u,%u,%u", stats.allocations, stats.reallocations, stats.deallocations);
+    for (int i = 0; i < MEMSTATS_NUMCLASSES; i++)
+        fprintf(file, ",%u", stats.classObjects[i]);
+    fprintf(file, "\n");
+
+    /* Make the statistics visible while the game runs */
+    if (file == stdout)
+        fflush(file);
+}
+
+void MemoryStatsLog::close()
+{
+    if (file && (file != stdout))
+        fclose(file);
+    file = nullptr;
+}
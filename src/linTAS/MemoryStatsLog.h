@@ -0,0 +1,45 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LINTAS_MEMORYSTATSLOG_H_INCLUDED
+#define LINTAS_MEMORYSTATSLOG_H_INCLUDED
+
+#include "../shared/MemoryStats.h"
+#include <cstdio>
+
+/* Write the statistics of the memory manager at each frame in CSV format,
+ * either to a file or to the standard output to watch them live.
+ */
+class MemoryStatsLog {
+    public:
+        ~MemoryStatsLog();
+
+        /* Open the file and write the CSV header. "-" is the standard output */
+        bool open(const char* filename);
+
+        /* Write the statistics of a frame */
+        void write(const MemoryStats& stats);
+
+        void close();
+
+    private:
+        FILE* file = nullptr;
+};
+
+#endif
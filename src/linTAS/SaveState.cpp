@@ -29,7 +29,9 @@
 #include <dirent.h>
 #include <fcntl.h>   // open
 #include <unistd.h>  // read, write, close
-#include <cstdio>    // BUFSIZ
+#include <cstdio>
+#include <algorithm> // std::min
+#include "../shared/instance.h"
 
 static void attachToGame(pid_t game_pid)
 {
@@ -94,6 +96,47 @@ static void detachToGame(pid_t game_pid)
     ptrace(PTRACE_DETACH, game_pid, nullptr, nullptr);
 }
 
+/*
+ * Copy the content of a file into another one at the same offsets, skipping
+ * the holes of the source. The memory manager punches holes in the heap file
+ * where memory is free, so that only the live data is copied.
+ * If punch_holes is set, the holes of the source are also punched into the
+ * destination, so that they read as zeros.
+ */
+static void copyFileData(int src_fd, int dst_fd, bool punch_holes)
+{
+    static char buf[1 << 16];
+    off_t end = lseek(src_fd, 0, SEEK_END);
+    off_t offset = 0;
+
+    while (offset < end) {
+        /* Fails with ENXIO if there is no data after offset */
+        off_t data = lseek(src_fd, offset, SEEK_DATA);
+        if (data < 0)
+            data = end;
+
+        if (punch_holes && (data > offset))
+            fallocate(dst_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, data - offset);
+
+        if (data >= end)
+            break;
+
+        off_t hole = lseek(src_fd, data, SEEK_HOLE);
+        if (hole < 0)
+            hole = end;
+
+        for (offset = data; offset < hole; ) {
+            size_t len = std::min(static_cast<off_t>(sizeof(buf)), hole - offset);
+            ssize_t size = pread(src_fd, buf, len, offset);
+            if (size <= 0)
+                return;
+            if (pwrite(dst_fd, buf, size, offset) != size)
+                return;
+            offset += size;
+        }
+    }
+}
+
 /*
  * Access and save all memory regions of the game process that are writable.
  */
@@ -184,14 +227,16 @@ bool SaveState::save(pid_t game_pid)
     attachToGame(game_pid);
 
     /* Save heap memory */
-    int heap_fd = shm_open("/libtas", O_RDONLY, 0666);
-    int state_fd = open("savestate.bin", O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    char buf[BUFSIZ];
-    size_t size;
+    char shm_name[64], state_path[64];
+    instanceShmName(shm_name, sizeof(shm_name));
+    instanceSaveStatePath(state_path, sizeof(state_path));
+    int heap_fd = shm_open(shm_name, O_RDONLY, 0666);
+    int state_fd = open(state_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
 
-    while ((size = read(heap_fd, buf, BUFSIZ)) > 0) {
-        write(state_fd, buf, size);
-    }
+    /* The savestate is a sparse file of the same size as the heap */
+    copyFileData(heap_fd, state_fd, false);
+    if (ftruncate(state_fd, lseek(heap_fd, 0, SEEK_END)) != 0)
+        std::cerr << "Could not resize the savestate file" << std::endl;
 
     close(heap_fd);
     close(state_fd);
@@ -248,14 +293,14 @@ bool SaveState::load(pid_t game_pid)
      */
     attachToGame(game_pid);
 
-    int heap_fd = shm_open("/libtas", O_WRONLY, 0666);
-    int state_fd = open("savestate.bin", O_RDONLY, 0644);
-    char buf[BUFSIZ];
-    size_t size;
+    char shm_name[64], state_path[64];
+    instanceShmName(shm_name, sizeof(shm_name));
+    instanceSaveStatePath(state_path, sizeof(state_path));
+    int heap_fd = shm_open(shm_name, O_WRONLY, 0666);
+    int state_fd = open(state_path, O_RDONLY, 0644);
 
-    while ((size = read(state_fd, buf, BUFSIZ)) > 0) {
-        write(heap_fd, buf, size);
-    }
+    /* Memory that was free when saving must also be zeroed */
+    copyFileData(state_fd, heap_fd, true);
 
     close(heap_fd);
     close(state_fd);
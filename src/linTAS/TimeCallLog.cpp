@@ -0,0 +1,82 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TimeCallLog.h"
+#include <cstring>
+
+TimeCallLog::~TimeCallLog()
+{
+    close();
+}
+
+bool TimeCallLog::open(const char* filename)
+{
+    if (strcmp(filename, "-") == 0)
+        file = stdout;
+    else
+        file = fopen(filename, "w");
+
+    if (!file)
+        return false;
+
+    fprintf(file, "frame");
+    for (int i = 0; i < TIMETYPE_NUMTRACKEDTYPES; i++)
+        fprintf(file, ",main_%s", timeCallTypeNames[i]);
+    for (int i = 0; i < TIMETYPE_NUMTRACKEDTYPES; i++)
+        fprintf(file, ",other_%s", timeCallTypeNames[i]);
+    fprintf(file, ",force_advances,other_advances,delay_calls,delay_ns");
+    for (int t = 1; t <= TIMECALLSTATS_MAXTHREADS; t++) {
+        for (int i = 0; i < TIMETYPE_NUMTRACKEDTYPES; i++)
+            fprintf(file, ",thread%d_%s", t, timeCallTypeNames[i]);
+        fprintf(file, ",thread%d_advances", t);
+    }
+    fprintf(file, "\n");
+    return true;
+}
+
+void TimeCallLog::write(const TimeCallStats& stats)
+{
+    if (!file)
+        return;
+
+    fprintf(file, "%lu", stats.frame);
+    for (int i = 0; i < TIMETYPE_NUMTRACKEDTYPES; i++)
+        fprintf(file, ",%u", stats.mainCalls[i]);
+    for (int i = 0; i < TIMETYPE_NUMTRACKEDTYPES; i++)
+        fprintf(file, ",%u", stats.otherCalls[i]);
+    fprintf(file, ",%u,%u,%u,%llu", stats.forceAdvances, stats.threadAdvances,
+            stats.delayCalls, static_cast<unsigned long long>(stats.delayTotal));
+    for (int t = 0; t < TIMECALLSTATS_MAXTHREADS; t++) {
+        for (int i = 0; i < TIMETYPE_NUMTRACKEDTYPES; i++)
+            fprintf(file, ",%u", stats.threadCalls[t][i]);
+        fprintf(file, ",%u", stats.threadClockAdvances[t]);
+    }
+    fprintf(file, "\n");
+
+    /* Make the statistics visible while the game runs */
+    if (file == stdout)
+        fflush(file);
+}
+
+void TimeCallLog::close()
+{
+    if (file && (file != stdout))
+        fclose(file);
+    file = nullptr;
+}
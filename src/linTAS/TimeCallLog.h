@@ -0,0 +1,48 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LINTAS_TIMECALLLOG_H_INCLUDED
+#define LINTAS_TIMECALLLOG_H_INCLUDED
+
+#include "../shared/TimeCallStats.h"
+#include <cstdio>
+
+/* Write the statistics of the time queries of each frame in CSV format,
+ * either to a file or to the standard output to watch them live.
+ * The main_* columns are the queries of the main thread, the other_*
+ * columns are the totals over all the other threads, and the threadN_*
+ * columns are the queries of the first other threads, one by one.
+ */
+class TimeCallLog {
+    public:
+        ~TimeCallLog();
+
+        /* Open the file and write the CSV header. "-" is the standard output */
+        bool open(const char* filename);
+
+        /* Write the statistics of a frame */
+        void write(const TimeCallStats& stats);
+
+        void close();
+
+    private:
+        FILE* file = nullptr;
+};
+
+#endif
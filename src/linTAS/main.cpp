@@ -21,7 +21,12 @@
 #include <stdio.h>
 #include <time.h>
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <stdint.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 #include <sys/un.h>
 #include <string.h>
 #include <X11/Xlib.h>
@@ -29,17 +34,34 @@
 #include <X11/XKBlib.h>
 #include "../shared/tasflags.h"
 #include "../shared/messages.h"
+#include "../shared/Config.h"
 #include "keymapping.h"
 #include "recording.h"
 #include "SaveState.h"
+#include "FrameProfile.h"
+#include "TimeCallLog.h"
+#include "MemoryStatsLog.h"
+#include "../shared/MessageSocket.h"
+#include "../shared/instance.h"
 #include <vector>
 #include <string>
 
 #define MAGIC_NUMBER 42
-#define SOCKET_FILENAME "/tmp/libTAS.socket"
 
 SaveState savestate;
 
+/* Framed messages exchanged with the game */
+MessageSocket gamesocket;
+
+/* Frame boundary timings, only sent by a profiling build of libTAS */
+FrameProfile frameprofile;
+
+/* Statistics of the time queries of the game, if requested */
+TimeCallLog timecalllog;
+
+/* Statistics of the memory manager of the game, if requested */
+MemoryStatsLog memorystatslog;
+
 unsigned long int frame_counter = 0;
 
 char keyboard_state[32];
@@ -52,6 +74,179 @@ pid_t game_pid;
 
 std::vector<std::string> shared_libs;
 
+/* Number of frames of inputs that are sent ahead of time during playback.
+ * 0 means that inputs are only sent when the game asks for them */
+unsigned long prefetch_window = 0;
+
+/* Next frame of the movie to be sent ahead of time. The game keeps the
+ * frames before it that we already sent, until we ask it to discard them */
+unsigned long prefetch_next = 0;
+
+/* Frame of the last frame boundary of the game, with or without waiting for us */
+unsigned long prefetch_last_frame = 0;
+
+/* Number of frames in the movie when playing back */
+unsigned long movie_frames = 0;
+
+/* Did we ask the game to discard the prefetched inputs, and are we waiting
+ * for the game to ask us for inputs again? */
+bool prefetch_flushed = false;
+
+/* Batch mode: play back a movie as fast as possible, without any display
+ * connection nor hotkeys, then exit with a status code */
+bool batch_mode = false;
+
+/* Default number of frames sent ahead of time in batch mode */
+#define BATCH_PREFETCH_WINDOW 16
+
+/* Maximum time we wait for the game to accept our connection, in ms */
+#define CONNECT_TIMEOUT 10000
+
+/* Exit status of batch mode */
+enum {
+    BATCH_SUCCESS = 0, // The whole movie was played back
+    BATCH_GAME_QUIT = 1, // The game quit before the end of the movie
+    BATCH_ERROR = 2, // Could not run the game or communicate with it
+};
+
+/* Connect to the game socket. The game may not be listening yet,
+ * so we try again until the timeout is reached.
+ */
+static bool connectToGame(int socket_fd, const struct sockaddr_un& addr)
+{
+    struct timespec tim = {0, 10000000L};
+    for (int t = 0; t < CONNECT_TIMEOUT; t += 10) {
+        if (connect(socket_fd, reinterpret_cast<const struct sockaddr*>(&addr), sizeof(struct sockaddr_un)) == 0)
+            return true;
+        if ((errno != ENOENT) && (errno != ECONNREFUSED))
+            return false;
+        nanosleep(&tim, NULL);
+    }
+    return false;
+}
+
+/* Print the statistics of the batch playback */
+static void printBatchStats(const struct timespec& start_time, unsigned long frames)
+{
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double wall_time = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1000000000.0;
+
+    printf("Played %lu frames out of %lu\n", frames, movie_frames);
+    printf("Wall time: %.3f s\n", wall_time);
+    if (wall_time > 0)
+        printf("Frames per second: %.1f\n", frames / wall_time);
+}
+
+/* Frame-advance auto-repeat: delay before the first repeat, and period of
+ * the following ones, in ms */
+#define AR_DELAY 500
+#define AR_PERIOD 20
+#define AR_PERIOD_FASTFORWARD 80
+
+/* Arm or disarm the frame-advance auto-repeat timer */
+static void setAutoRepeat(int timer_fd, bool enable)
+{
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (enable) {
+        int period = tasflags.fastforward ? AR_PERIOD_FASTFORWARD : AR_PERIOD;
+        its.it_value.tv_sec = AR_DELAY / 1000;
+        its.it_value.tv_nsec = (AR_DELAY % 1000) * 1000000L;
+        its.it_interval.tv_sec = period / 1000;
+        its.it_interval.tv_nsec = (period % 1000) * 1000000L;
+    }
+    timerfd_settime(timer_fd, 0, &its, NULL);
+}
+
+/* Return if the auto-repeat timer expired since the last call */
+static bool autoRepeatExpired(int timer_fd)
+{
+    uint64_t expirations;
+    return (read(timer_fd, &expirations, sizeof(uint64_t)) == sizeof(uint64_t)) && (expirations > 0);
+}
+
+/* Block until an X event arrives, the auto-repeat timer expires or
+ * something happens on the game socket. Events already read by Xlib
+ * must have been processed before calling this.
+ * Returns false if the connection with the game was closed.
+ */
+static bool waitForEvents(Display *display, int socket_fd, int timer_fd)
+{
+    struct pollfd fds[3];
+    fds[0].fd = ConnectionNumber(display);
+    fds[0].events = POLLIN;
+    fds[1].fd = socket_fd;
+    fds[1].events = POLLIN;
+    fds[2].fd = timer_fd;
+    fds[2].events = POLLIN;
+
+    /* Send any pending request to the X server before sleeping */
+    XFlush(display);
+
+    while (poll(fds, 3, -1) < 0) {
+        if (errno != EINTR)
+            return false;
+    }
+
+    /* The game is waiting for us at the frame boundary, so it must not send
+     * anything. Any activity on the socket means that it was closed. */
+    return !(fds[1].revents & (POLLIN | POLLHUP | POLLERR));
+}
+
+/* Return if the event is a key event on a hotkey */
+static bool isHotkeyEvent(Display *display, XEvent *event)
+{
+    if ((event->type != KeyPress) && (event->type != KeyRelease))
+        return false;
+
+    KeySym ks = XkbKeycodeToKeysym(display, event->xkey.keycode, 0, 0);
+    for (int i=0; i<HOTKEY_LEN; i++)
+        if (ks == hotkeys[i])
+            return true;
+    return false;
+}
+
+/* Return if a hotkey event is pending, without changing the event queue.
+ * The pending events are drained in order, then put back in reverse order,
+ * so that they are still processed in the order they arrived.
+ */
+static bool hasPendingHotkey(Display *display)
+{
+    std::vector<XEvent> events;
+    bool found = false;
+
+    int count = XEventsQueued(display, QueuedAfterReading);
+    for (int i=0; i<count; i++) {
+        XEvent event;
+        XNextEvent(display, &event);
+        if (isHotkeyEvent(display, &event))
+            found = true;
+        events.push_back(event);
+    }
+
+    for (auto it = events.rbegin(); it != events.rend(); ++it)
+        XPutBackEvent(display, &(*it));
+
+    return found;
+}
+
+/* Send the inputs of the next frames of the movie to the game ahead of time,
+ * so that the game has at least the inputs up to frame + prefetch_window.
+ */
+static void sendPrefetchedInputs(unsigned long frame)
+{
+    AllInputs ai;
+
+    while ((prefetch_next <= frame + prefetch_window) && (prefetch_next < movie_frames)) {
+        readFrame(fp, prefetch_next, &ai);
+        gamesocket.sendMessage(MSGN_PREFETCH_INPUTS);
+        gamesocket.sendData(&prefetch_next, sizeof(unsigned long));
+        gamesocket.sendData(&ai, sizeof(struct AllInputs));
+        prefetch_next++;
+    }
+}
+
 static int MyErrorHandler(Display *display, XErrorEvent *theEvent)
 {
     (void) fprintf(stderr,
@@ -69,7 +264,8 @@ int main(int argc, char **argv)
     /* Parsing arguments */
     int c;
     std::string libname, dumpfile;
-    while ((c = getopt (argc, argv, "r:w:d:l:")) != -1)
+    long empty_frames = -1;
+    while ((c = getopt (argc, argv, "r:w:d:l:p:bts:m:e:")) != -1)
         switch (c) {
             case 'r':
                 /* Playback movie file */
@@ -91,6 +287,43 @@ int main(int argc, char **argv)
                 libname = optarg;
                 shared_libs.push_back(libname);
                 break;
+            case 'p':
+                /* Number of frames of inputs sent ahead of time */
+                prefetch_window = strtoul(optarg, nullptr, 10);
+                break;
+            case 'b':
+                /* Headless batch playback */
+                batch_mode = true;
+                break;
+            case 't':
+                /* Turbo mode */
+                tasflags.turbo = 1;
+                break;
+            case 's':
+                /* Time query statistics */
+                if (!timecalllog.open(optarg)) {
+                    fprintf(stderr, "Could not open time statistics file %s\n", optarg);
+                    exit(1);
+                }
+                tasflags.timecall_stats = 1;
+                break;
+            case 'm':
+                /* Memory manager statistics, only sent by libTAS when it
+                 * uses its own memory manager */
+                if (!config.custom_memorymanager) {
+                    fprintf(stderr, "Memory statistics need the custom memory manager, which is disabled in src/shared/Config.cpp\n");
+                    exit(1);
+                }
+                if (!memorystatslog.open(optarg)) {
+                    fprintf(stderr, "Could not open memory statistics file %s\n", optarg);
+                    exit(1);
+                }
+                tasflags.memory_stats = 1;
+                break;
+            case 'e':
+                /* Only write a movie with no input, of the given number of frames */
+                empty_frames = strtol(optarg, nullptr, 10);
+                break;
             case '?':
                 fprintf (stderr, "Unknown option character");
                 break;
@@ -98,116 +331,172 @@ int main(int argc, char **argv)
                 return 1;
         }
 
-    const struct sockaddr_un addr = { AF_UNIX, SOCKET_FILENAME };
+    if (empty_frames >= 0) {
+        if (tasflags.recording != 1) {
+            fprintf(stderr, "Writing an empty movie needs the movie file to write to\n");
+            exit(1);
+        }
+        if (!writeEmptyMovie(moviefile, empty_frames)) {
+            fprintf(stderr, "Could not write movie file %s\n", moviefile);
+            exit(1);
+        }
+        return 0;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    instanceSocketPath(addr.sun_path, sizeof(addr.sun_path));
     int socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
 
-    Display *display;
+    Display *display = NULL;
     XEvent event;
     // Find the window which has the current keyboard focus
     Window gameWindow = 0;
     struct timespec tim;
 
-    XSetErrorHandler(MyErrorHandler);
+    if (batch_mode) {
+        if (tasflags.recording != 0) {
+            fprintf(stderr, "Batch mode requires a movie to play back\n");
+            exit(BATCH_ERROR);
+        }
 
-    /* open connection with the server */
-    display = XOpenDisplay(NULL);
-    if (display == NULL)
-    {
-        fprintf(stderr, "Cannot open display\n");
-        exit(1);
+        /* Run as fast as possible. Nothing needs to be presented
+         * nor played, unless we are dumping */
+        tasflags.running = 1;
+        tasflags.fastforward = 1;
+        tasflags.turbo = 1;
+        if (prefetch_window == 0)
+            prefetch_window = BATCH_PREFETCH_WINDOW;
+    }
+    else {
+        XSetErrorHandler(MyErrorHandler);
+
+        /* open connection with the server */
+        display = XOpenDisplay(NULL);
+        if (display == NULL)
+        {
+            fprintf(stderr, "Cannot open display\n");
+            exit(1);
+        }
     }
 
+    if (tasflags.recording >= 0){
+        fp = openRecording(moviefile, tasflags.recording);
+        if (!fp) {
+            fprintf(stderr, "Could not open movie file %s\n", moviefile);
+            exit(batch_mode ? BATCH_ERROR : 1);
+        }
+    }
+
+    if (tasflags.recording == 0) {
+        movie_frames = countFrames(fp);
+    }
 
     printf("Connecting to libTAS...\n");
 
-    if (connect(socket_fd, reinterpret_cast<const struct sockaddr*>(&addr), sizeof(struct sockaddr_un)))
+    if (!connectToGame(socket_fd, addr))
     {
         printf("Couldn’t connect to socket.\n");
-        return 1;
+        return batch_mode ? BATCH_ERROR : 1;
     }
 
     printf("Connected.\n");
 
+    gamesocket.setFd(socket_fd);
+
     /* Receive informations from the game */
 
-    recv(socket_fd, &message, sizeof(int), 0);
+    gamesocket.receiveMessage(message);
     while (message != MSGB_END_INIT) {
 
         switch (message) {
             /* Get the game process pid */
             case MSGB_PID:
-                recv(socket_fd, &game_pid, sizeof(pid_t), 0);
+                gamesocket.receiveData(&game_pid, sizeof(pid_t));
                 break;
 
             default:
                 fprintf(stderr, "Message init: unknown message\n");
-                exit(1);
+                exit(batch_mode ? BATCH_ERROR : 1);
+        }
+        if (!gamesocket.receiveMessage(message)) {
+            fprintf(stderr, "Message init: connection closed\n");
+            exit(batch_mode ? BATCH_ERROR : 1);
         }
-        recv(socket_fd, &message, sizeof(int), 0);
     }
 
     /* Send informations to the game */
 
     /* Send TAS flags */
-    message = MSGN_TASFLAGS;
-    send(socket_fd, &message, sizeof(int), 0);
-    send(socket_fd, &tasflags, sizeof(struct TasFlags), 0);
+    gamesocket.sendMessage(MSGN_TASFLAGS);
+    gamesocket.sendData(&tasflags, sizeof(struct TasFlags));
 
     /* Send dump file */
     if (tasflags.av_dumping) {
-        message = MSGN_DUMP_FILE;
-        send(socket_fd, &message, sizeof(int), 0);
+        gamesocket.sendMessage(MSGN_DUMP_FILE);
         size_t dumpfile_size = dumpfile.size();
-        send(socket_fd, &dumpfile_size, sizeof(size_t), 0);
-        send(socket_fd, dumpfile.c_str(), dumpfile_size, 0);
+        gamesocket.sendData(&dumpfile_size, sizeof(size_t));
+        gamesocket.sendData(dumpfile.c_str(), dumpfile_size);
     }
 
     /* Send shared library names */
     for (auto &name : shared_libs) {
-        message = MSGN_LIB_FILE;
-        send(socket_fd, &message, sizeof(int), 0);
+        gamesocket.sendMessage(MSGN_LIB_FILE);
         size_t name_size = name.size();
-        send(socket_fd, &name_size, sizeof(size_t), 0);
-        send(socket_fd, name.c_str(), name_size, 0);
+        gamesocket.sendData(&name_size, sizeof(size_t));
+        gamesocket.sendData(name.c_str(), name_size);
     }
 
     /* End message */
-    message = MSGN_END_INIT;
-    send(socket_fd, &message, sizeof(int), 0);
+    gamesocket.sendMessage(MSGN_END_INIT);
+    gamesocket.flush();
 
-    tim.tv_sec  = 1;
-    tim.tv_nsec = 0L;
+    /* In batch mode, the init messages are enough to know that the game
+     * is ready, and there is no user to give some time to. */
+    if (!batch_mode) {
+        tim.tv_sec  = 1;
+        tim.tv_nsec = 0L;
 
-    nanosleep(&tim, NULL);
+        nanosleep(&tim, NULL);
+    }
 
     default_hotkeys(hotkeys);
 
-    if (tasflags.recording >= 0){
-        fp = openRecording(moviefile, tasflags.recording);
-    }
+    int exit_status = BATCH_ERROR;
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
 
-    /*
-     * Frame advance auto-repeat variables.
-     * If ar_ticks is >= 0 (auto-repeat activated), it increases by one every iteration of the do loop
-     * If ar_ticks > ar_delay and ar_ticks % ar_freq == 0 then trigger frame advance
-     */
-    int ar_ticks = -1;
-    int ar_delay = 50;
-    int ar_freq = tasflags.fastforward ? 8 : 2;
+    /* Timer triggering the frame-advance auto-repeat */
+    int ar_fd = -1;
+    if (!batch_mode) {
+        ar_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (ar_fd < 0) {
+            fprintf(stderr, "Could not create the auto-repeat timer\n");
+            exit(1);
+        }
+    }
+    bool game_closed = false;
 
     while (1)
     {
         
         /* Wait for frame boundary */
-        recv(socket_fd, &message, sizeof(int), 0);
+        if (!gamesocket.receiveMessage(message)) {
+            printf("Connection with the game was closed. Exiting\n");
+            break;
+        }
 
         if (message == MSGB_QUIT) {
             printf("Game has quit. Exiting\n");
+            exit_status = BATCH_GAME_QUIT;
             break;
         }
 
         if (message == MSGB_WINDOW_ID) {
-            recv(socket_fd, &gameWindow, sizeof(Window), 0);
+            gamesocket.receiveData(&gameWindow, sizeof(Window));
+            if (batch_mode)
+                continue;
             if (gameWindow == 0) {
                 /* libTAS could not get the window id
                  * Let's get the active window */
@@ -224,7 +513,53 @@ int main(int argc, char **argv)
                 fprintf(stderr, "Keyboard is already grabbed\n");    
             }
 #endif
-            recv(socket_fd, &message, sizeof(int), 0);
+            continue;
+        }
+
+        if (message == MSGB_FRAME_TIMINGS) {
+            FrameTimings timings;
+            gamesocket.receiveData(&timings, sizeof(struct FrameTimings));
+            frameprofile.add(timings);
+            continue;
+        }
+
+        if (message == MSGB_TIMECALL_STATS) {
+            TimeCallStats stats;
+            gamesocket.receiveData(&stats, sizeof(struct TimeCallStats));
+            timecalllog.write(stats);
+            continue;
+        }
+
+        if (message == MSGB_MEMORY_STATS) {
+            MemoryStats stats;
+            gamesocket.receiveData(&stats, sizeof(struct MemoryStats));
+            memorystatslog.write(stats);
+            continue;
+        }
+
+        if (message == MSGB_PREFETCHED_FRAME) {
+            /* The game went through a frame boundary without waiting for us */
+            gamesocket.receiveData(&frame_counter, sizeof(unsigned long));
+            prefetch_last_frame = frame_counter;
+
+            /* The game did not yet process our flush, nothing to do */
+            if (prefetch_flushed)
+                continue;
+
+            /* If a hotkey was used, we must stop the game at the next frame
+             * boundary. The event stays in the queue so that it is processed
+             * there, with the other events.
+             */
+            if (display && hasPendingHotkey(display)) {
+                gamesocket.sendMessage(MSGN_PREFETCH_FLUSH);
+                gamesocket.flush();
+                prefetch_flushed = true;
+                continue;
+            }
+
+            sendPrefetchedInputs(frame_counter);
+            gamesocket.flush();
+            continue;
         }
 
         if (message != MSGB_START_FRAMEBOUNDARY) {
@@ -232,8 +567,27 @@ int main(int argc, char **argv)
             exit(1);
         }
                    
-        recv(socket_fd, &frame_counter, sizeof(unsigned long), 0);
-
+        gamesocket.receiveData(&frame_counter, sizeof(unsigned long));
+
+        /* Did the game go back to an earlier frame, for example by loading
+         * a savestate? Then the frames it may still hold do not follow on */
+        bool prefetch_rewind = (frame_counter <= prefetch_last_frame) && (frame_counter > 0);
+        prefetch_last_frame = frame_counter;
+
+        /* We may have read the movie ahead of the game. Go back to the
+         * current frame, so that switching to recording truncates the movie
+         * and writes the inputs at the right place.
+         */
+        if ((prefetch_window > 0) && (tasflags.recording >= 0))
+            seekFrame(fp, frame_counter);
+
+        /* In batch mode, stop the game when the movie is over */
+        if (batch_mode && (frame_counter >= movie_frames)) {
+            printf("Movie is over. Exiting\n");
+            exit_status = BATCH_SUCCESS;
+            kill(game_pid, SIGTERM);
+            break;
+        }
 
         int isidle = !tasflags.running;
         int tasflagsmod = 0; // register if tasflags have been modified on this frame
@@ -245,15 +599,13 @@ int main(int argc, char **argv)
         /* We are at a frame boundary */
         do {
 
-            XQueryKeymap(display, keyboard_state);
-           
+            /* No hotkey to process in batch mode */
+            if (batch_mode)
+                break;
+
             /* Implement frame-advance auto-repeat */
-            if (ar_ticks >= 0) {
-                ar_ticks++;
-                if ((ar_ticks > ar_delay) && !(ar_ticks % ar_freq))
-                    /* Trigger auto-repeat */
-                    isidle = 0;
-            }
+            if (autoRepeatExpired(ar_fd))
+                isidle = 0;
 
             while( XPending( display ) ) {
 
@@ -283,7 +635,7 @@ int main(int argc, char **argv)
                         isidle = 0;
                         tasflags.running = 0;
                         tasflagsmod = 1;
-                        ar_ticks = 0; // Activate auto-repeat
+                        setAutoRepeat(ar_fd, true);
                     }
                     if (ks == hotkeys[HOTKEY_PLAYPAUSE]){
                         tasflags.running = !tasflags.running;
@@ -338,20 +690,24 @@ int main(int argc, char **argv)
                         tasflagsmod = 1;
                     }
                     if (ks == hotkeys[HOTKEY_FRAMEADVANCE]){
-                        ar_ticks = -1; // Deactivate auto-repeat
+                        setAutoRepeat(ar_fd, false);
                     }
                 }
             }
 
-            /* Sleep a bit to not surcharge the processor */
-            if (isidle) {
-                tim.tv_sec  = 0;
-                tim.tv_nsec = 10000000L;
-                nanosleep(&tim, NULL);
+            /* Sleep until something happens */
+            if (isidle && !waitForEvents(display, socket_fd, ar_fd)) {
+                game_closed = true;
+                break;
             }
 
         } while (isidle);
 
+        if (game_closed) {
+            printf("Connection with the game was closed. Exiting\n");
+            break;
+        }
+
         AllInputs ai;
 
         if (tasflags.recording == -1) {
@@ -401,6 +757,11 @@ int main(int argc, char **argv)
         if (tasflags.recording == 0) {
             /* Save inputs to file */
             if (!readFrame(fp, frame_counter, &ai)) {
+                if (batch_mode) {
+                    fprintf(stderr, "Could not read frame %lu of the movie\n", frame_counter);
+                    kill(game_pid, SIGTERM);
+                    break;
+                }
                 /* Writing failed, returning to no recording mode */
                 tasflags.recording = -1;
             }
@@ -408,18 +769,36 @@ int main(int argc, char **argv)
 
         /* Send tasflags if modified */
         if (tasflagsmod) {
-            message = MSGN_TASFLAGS;
-            send(socket_fd, &message, sizeof(int), 0);
-            send(socket_fd, &tasflags, sizeof(struct TasFlags), 0);
+            gamesocket.sendMessage(MSGN_TASFLAGS);
+            gamesocket.sendData(&tasflags, sizeof(struct TasFlags));
         }
 
-        /* Send inputs and end of frame */
-        message = MSGN_ALL_INPUTS;
-        send(socket_fd, &message, sizeof(int), 0);
-        send(socket_fd, &ai, sizeof(struct AllInputs), 0);
-
-        message = MSGN_END_FRAMEBOUNDARY; 
-        send(socket_fd, &message, sizeof(int), 0);
+        /* Send inputs and end of frame, all at once */
+        gamesocket.sendMessage(MSGN_ALL_INPUTS);
+        gamesocket.sendData(&ai, sizeof(struct AllInputs));
+
+        gamesocket.sendMessage(MSGN_END_FRAMEBOUNDARY);
+
+        /* Send the inputs of the next frames ahead of time. Frames that
+         * were already sent and not discarded are not sent again. */
+        if (prefetch_flushed)
+            prefetch_next = 0;
+        bool prefetch = (prefetch_window > 0) && (tasflags.recording == 0) && tasflags.running;
+        if ((prefetch_next > frame_counter + 1) && (prefetch_rewind || !prefetch)) {
+            /* The game may hold frames that we will not play back next */
+            gamesocket.sendMessage(MSGN_PREFETCH_FLUSH);
+            prefetch_next = 0;
+        }
+        if (prefetch) {
+            /* The movie is positioned after the current frame */
+            if (prefetch_next <= frame_counter + 1)
+                prefetch_next = frame_counter + 1;
+            else
+                seekFrame(fp, prefetch_next);
+            sendPrefetchedInputs(frame_counter);
+        }
+        prefetch_flushed = false;
+        gamesocket.flush();
 
     }
 
@@ -427,6 +806,17 @@ int main(int argc, char **argv)
         closeRecording(fp);
     }
     close(socket_fd);
+    if (ar_fd >= 0)
+        close(ar_fd);
+
+    frameprofile.print();
+    timecalllog.close();
+    memorystatslog.close();
+
+    if (batch_mode) {
+        printBatchStats(start_time, frame_counter);
+        return exit_status;
+    }
     return 0;
 }
 
@@ -19,6 +19,12 @@
 
 #include "recording.h"
 
+/* Size of the inputs of a single frame inside the movie file */
+static const long FRAME_SIZE = sizeof(KeySym) * AllInputs::MAXKEYS +
+                               2 * sizeof(int) + sizeof(unsigned int) +
+                               sizeof(short) * AllInputs::MAXJOYS * AllInputs::MAXAXES +
+                               sizeof(unsigned short) * AllInputs::MAXJOYS;
+
 FILE* openRecording(const char* filename, int recording)
 {
     FILE* fp;
@@ -71,10 +77,13 @@ int readFrame(FILE* fp, unsigned long frame, struct AllInputs* inputs)
     size += fread(&inputs->pointer_mask, sizeof(unsigned int), 1, fp);
     size += fread(inputs->controller_axes, sizeof(short), AllInputs::MAXJOYS*AllInputs::MAXAXES, fp);
     size += fread(inputs->controller_buttons, sizeof(unsigned short), AllInputs::MAXJOYS, fp);
-    //if (size != sizeof(struct AllInputs)) {
-    //    printf("Did not read all (%zu elements), end of file?\n", size);
-    //    return 0;
-    //}
+
+    /* Number of elements of a frame */
+    size_t count = AllInputs::MAXKEYS + 3 + AllInputs::MAXJOYS*AllInputs::MAXAXES + AllInputs::MAXJOYS;
+    if (size != count) {
+        printf("Did not read all (%zu elements out of %zu), end of file?\n", size, count);
+        return 0;
+    }
     return 1;
 }
 
@@ -99,6 +108,39 @@ void truncateRecording(FILE* fp)
 
 }
 
+void seekFrame(FILE* fp, unsigned long frame)
+{
+    fseek(fp, HEADER_SIZE + frame * FRAME_SIZE, SEEK_SET);
+}
+
+unsigned long countFrames(FILE* fp)
+{
+    long current_pos = ftell(fp);
+    fseek(fp, 0, SEEK_END);
+    long end_pos = ftell(fp);
+    fseek(fp, current_pos, SEEK_SET);
+
+    if (end_pos < HEADER_SIZE)
+        return 0;
+    return (end_pos - HEADER_SIZE) / FRAME_SIZE;
+}
+
+int writeEmptyMovie(const char* filename, unsigned long frames)
+{
+    FILE* fp = openRecording(filename, 1);
+    if (!fp)
+        return 0;
+
+    AllInputs ai;
+    ai.emptyInputs();
+    for (unsigned long f = 0; f < frames; f++)
+        writeFrame(fp, f, ai);
+
+    int ok = !ferror(fp);
+    closeRecording(fp);
+    return ok;
+}
+
 void closeRecording(FILE* fp)
 {
     /* TODO: Write some stuff in the header */
@@ -32,6 +32,16 @@ void readHeader(FILE* fp);
 int writeFrame(FILE* fp, unsigned long frame, struct AllInputs inputs);
 int readFrame(FILE* fp, unsigned long frame, struct AllInputs* inputs);
 void truncateRecording(FILE* fp);
+
+/* Move the movie file position to the beginning of the frame */
+void seekFrame(FILE* fp, unsigned long frame);
+
+/* Return the number of frames stored in the movie file */
+unsigned long countFrames(FILE* fp);
+
+/* Write a movie of the given number of frames with no input.
+ * Returns 0 if the movie could not be written */
+int writeEmptyMovie(const char* filename, unsigned long frames);
 void closeRecording(FILE* fp);
 
 #endif
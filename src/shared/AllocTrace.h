@@ -0,0 +1,79 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_ALLOCTRACE_H_INCLUDED
+#define LIBTAS_ALLOCTRACE_H_INCLUDED
+
+#include <stdint.h>
+
+/* Binary trace of the dynamic allocations of a game, written by libTAS when
+ * the LIBTAS_ALLOC_TRACE environment variable holds the path of the trace,
+ * and replayed by the benchallocator program.
+ *
+ * The file starts with an AllocTraceHeader, followed by AllocTraceRecord
+ * structures in the order in which the calls returned. Addresses are
+ * replaced by ids, so that a trace can be replayed with any allocator:
+ * each successful allocation gets a new id, starting from 1, and 0 stands
+ * for a null pointer.
+ */
+
+#define ALLOCTRACE_MAGIC "LTASALLC"
+#define ALLOCTRACE_VERSION 1
+
+enum AllocTraceOp
+{
+    ALLOCTRACE_MALLOC = 0,
+    ALLOCTRACE_CALLOC,
+    ALLOCTRACE_REALLOC,
+    ALLOCTRACE_MEMALIGN,
+    ALLOCTRACE_FREE,
+};
+
+struct AllocTraceHeader {
+    char magic[8];
+    uint32_t version;
+
+    /* Size of each record, to detect incompatible traces */
+    uint32_t record_size;
+};
+
+struct AllocTraceRecord {
+    /* One of AllocTraceOp */
+    uint8_t op;
+
+    /* Base 2 logarithm of the alignment of ALLOCTRACE_MEMALIGN */
+    uint8_t align_shift;
+
+    /* Index of the calling thread, in the order threads first allocated */
+    uint16_t thread;
+
+    /* Frame during which the call was made */
+    uint32_t frame;
+
+    /* Id of the returned allocation, or of the freed one */
+    uint32_t id;
+
+    /* Id of the previous allocation of ALLOCTRACE_REALLOC */
+    uint32_t old_id;
+
+    /* Requested size in bytes, with both calloc arguments multiplied */
+    uint64_t size;
+};
+
+#endif
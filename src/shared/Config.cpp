@@ -22,7 +22,10 @@
 struct Config config = {
     hud_framecount : true,
     hud_inputs : true,
+    hud_memory : false,
     custom_memorymanager : false,
+    memorymanager_hugepages : false,
+    memorymanager_fixed_base : false,
     prevent_savefiles : true
 }; 
 
@@ -27,8 +27,18 @@ struct Config {
     /* Display inputs in the HUD */
     bool hud_inputs;
 
+    /* Display the statistics of our memory manager in the HUD */
+    bool hud_memory;
+
     /* Do we use our custom memory manager for dynamically allocated memory? */
     bool custom_memorymanager;
+
+    /* Ask for transparent huge pages on large allocations of our memory manager */
+    bool memorymanager_hugepages;
+
+    /* Place the heap of our memory manager at a fixed address, so that
+     * allocation addresses are the same in every run of a movie */
+    bool memorymanager_fixed_base;
     
     /* Prevent the game to write into savefiles */
     bool prevent_savefiles;
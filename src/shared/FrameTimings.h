@@ -0,0 +1,48 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_FRAMETIMINGS_H_INCLUDED
+#define LIBTAS_FRAMETIMINGS_H_INCLUDED
+
+#include <stdint.h>
+
+/* Time spent in each phase of a frame boundary, in nanoseconds.
+ * Only measured when libTAS is built with frame profiling.
+ */
+struct FrameTimings {
+    /* Updating the deterministic timer when entering and leaving */
+    uint64_t timer;
+
+    /* Drawing the screen (or skipping it) */
+    uint64_t draw;
+
+    /* Blocked on the socket, waiting for messages from the program */
+    uint64_t ipc_wait;
+
+    /* Processing the messages from the program */
+    uint64_t commands;
+
+    /* Pushing native events and generating input events */
+    uint64_t events;
+
+    /* Whole frame boundary */
+    uint64_t total;
+};
+
+#endif
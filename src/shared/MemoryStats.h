@@ -0,0 +1,63 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_MEMORYSTATS_H_INCLUDED
+#define LIBTAS_MEMORYSTATS_H_INCLUDED
+
+#include <stdint.h>
+
+/* Number of size classes of the small allocations of the memory manager.
+ * Classes 0 to 7 hold objects of 16 to 128 bytes by steps of 16 bytes.
+ * Above, each power of two is split into four classes, up to 2048 bytes.
+ */
+#define MEMSTATS_NUMCLASSES 24
+
+/* Statistics of the memory manager at the end of a frame, sent to the
+ * program when tasflags.memory_stats is set.
+ */
+struct MemoryStats {
+    /* Frame at the end of which the statistics were taken */
+    unsigned long frame;
+
+    /* Number of bytes of live allocations. Small allocations are rounded
+     * up to the size of their class, and heap allocations to their blocks */
+    uint64_t bytesInUse;
+
+    /* Number of bytes of the shared memory file that hold pages, which is
+     * what a savestate has to copy. Released free pages are holes in the
+     * file and are not counted.
+     * The fragmentation ratio is 1 - bytesInUse / bytesAllocated */
+    uint64_t bytesAllocated;
+
+    /* Number of bitmap heap blocks, slab arenas and large extents */
+    uint32_t heapBlocks;
+    uint32_t slabArenas;
+    uint32_t largeExtents;
+
+    /* Number of live small objects of each size class */
+    uint32_t classObjects[MEMSTATS_NUMCLASSES];
+
+    /* Number of allocations, reallocations and deallocations made
+     * during the frame */
+    uint32_t allocations;
+    uint32_t reallocations;
+    uint32_t deallocations;
+};
+
+#endif
@@ -0,0 +1,187 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MessageSocket.h"
+#include <sys/uio.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h> // IOV_MAX
+#include <cstring>
+
+/* Initial size of the receive buffer, which is enough for several frames */
+#define MESSAGESOCKET_BUFSIZE 4096
+
+void MessageSocket::setFd(int socket_fd)
+{
+    fd = socket_fd;
+    outHeaders.clear();
+    outPayloads.clear();
+    inBuffer.resize(MESSAGESOCKET_BUFSIZE);
+    inBegin = inEnd = 0;
+    payloadBegin = payloadEnd = 0;
+}
+
+void MessageSocket::sendMessage(int type)
+{
+    MessageHeader header;
+    header.length = 0;
+    header.type = type;
+    outHeaders.push_back(header);
+}
+
+void MessageSocket::sendData(const void* elem, size_t size)
+{
+    if (outHeaders.empty())
+        return;
+
+    outHeaders.back().length += size;
+    const uint8_t* bytes = static_cast<const uint8_t*>(elem);
+    outPayloads.insert(outPayloads.end(), bytes, bytes + size);
+}
+
+bool MessageSocket::flush(void)
+{
+    if (outHeaders.empty())
+        return true;
+
+    /* Build the list of buffers to send. It must be done here, because the
+     * payload storage may have moved while we were queueing messages.
+     */
+    std::vector<struct iovec> iovs;
+    iovs.reserve(2 * outHeaders.size());
+    size_t offset = 0;
+    for (auto& header : outHeaders) {
+        iovs.push_back({&header, sizeof(MessageHeader)});
+        if (header.length > 0) {
+            iovs.push_back({outPayloads.data() + offset, header.length});
+            offset += header.length;
+        }
+    }
+
+    /* Loop until everything is written, and adjust the buffers
+     * on short writes */
+    struct iovec* iov = iovs.data();
+    int iovcnt = iovs.size();
+    bool success = true;
+    while (iovcnt > 0) {
+        ssize_t ret = writev(fd, iov, (iovcnt > IOV_MAX) ? IOV_MAX : iovcnt);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            success = false;
+            break;
+        }
+
+        size_t written = ret;
+        while ((iovcnt > 0) && (written >= iov->iov_len)) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    outHeaders.clear();
+    outPayloads.clear();
+    return success;
+}
+
+bool MessageSocket::fill(size_t size)
+{
+    if (inEnd - inBegin >= size)
+        return true;
+
+    /* Move the unparsed data to the beginning of the buffer */
+    if (inBegin > 0) {
+        memmove(inBuffer.data(), inBuffer.data() + inBegin, inEnd - inBegin);
+        inEnd -= inBegin;
+        inBegin = 0;
+    }
+
+    if (inBuffer.size() < size)
+        inBuffer.resize(size);
+
+    /* Read as much as available, until we get enough data */
+    while (inEnd < size) {
+        ssize_t ret = read(fd, inBuffer.data() + inEnd, inBuffer.size() - inEnd);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (ret == 0) {
+            /* Connection was closed */
+            return false;
+        }
+        inEnd += ret;
+    }
+    return true;
+}
+
+bool MessageSocket::receiveMessage(int& type)
+{
+    if (!flush())
+        return false;
+
+    if (!fill(sizeof(MessageHeader)))
+        return false;
+
+    MessageHeader header;
+    memcpy(&header, inBuffer.data() + inBegin, sizeof(MessageHeader));
+
+    if (!fill(sizeof(MessageHeader) + header.length))
+        return false;
+
+    type = header.type;
+    payloadBegin = inBegin + sizeof(MessageHeader);
+    payloadEnd = payloadBegin + header.length;
+
+    /* The message is parsed, its payload stays in the buffer until
+     * the next call to fill() */
+    inBegin = payloadEnd;
+    return true;
+}
+
+bool MessageSocket::receiveData(void* elem, size_t size)
+{
+    if (payloadEnd - payloadBegin < size)
+        return false;
+
+    memcpy(elem, inBuffer.data() + payloadBegin, size);
+    payloadBegin += size;
+    return true;
+}
+
+bool MessageSocket::isPending(void)
+{
+    /* Check if a full message was already received */
+    if (inEnd - inBegin >= sizeof(MessageHeader)) {
+        MessageHeader header;
+        memcpy(&header, inBuffer.data() + inBegin, sizeof(MessageHeader));
+        if (inEnd - inBegin >= sizeof(MessageHeader) + header.length)
+            return true;
+    }
+
+    struct pollfd pfd = {fd, POLLIN, 0};
+    return (poll(&pfd, 1, 0) > 0) && (pfd.revents & POLLIN);
+}
@@ -0,0 +1,99 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_MESSAGESOCKET_H_INCLUDED
+#define LIBTAS_MESSAGESOCKET_H_INCLUDED
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/* Header that precedes each message sent between libTAS and linTAS */
+struct MessageHeader {
+    /* Size of the payload following the header, in bytes */
+    uint32_t length;
+
+    /* Message identifier, taken from messages.h */
+    int32_t type;
+};
+
+/* Framed message protocol over a stream socket, shared by libTAS and linTAS.
+ *
+ * Each message is sent as a header (length and type) followed by its payload.
+ * Messages are not sent immediately, but queued until flush() is called,
+ * so that all messages of a frame boundary go out in a single writev() call.
+ * On the receiving side, we read as much data as available in a single
+ * call, then messages are parsed from our buffer.
+ *
+ * Short reads and writes are handled, so a message is always received in
+ * full, whatever the size of its payload.
+ */
+class MessageSocket {
+    public:
+        /* Set the socket file descriptor to use */
+        void setFd(int fd);
+
+        /* Queue a new message with an empty payload */
+        void sendMessage(int type);
+
+        /* Append data to the payload of the last queued message.
+         * Data is copied, so it can be modified right after this call.
+         */
+        void sendData(const void* elem, size_t size);
+
+        /* Send all queued messages. Returns false if an error occured */
+        bool flush(void);
+
+        /* Receive the next message and store its type. Queued messages
+         * are sent beforehand, because we are probably waiting for an answer.
+         * Returns false if an error occured or if the other side has closed
+         * the connection.
+         */
+        bool receiveMessage(int& type);
+
+        /* Copy the next size bytes of the payload of the last received
+         * message. Returns false if the payload is too short.
+         */
+        bool receiveData(void* elem, size_t size);
+
+        /* Check, without blocking, if a message can be received */
+        bool isPending(void);
+
+    private:
+        int fd = -1;
+
+        /* Queued headers and payloads to be sent */
+        std::vector<MessageHeader> outHeaders;
+        std::vector<uint8_t> outPayloads;
+
+        /* Received data, and position of the unparsed data inside */
+        std::vector<uint8_t> inBuffer;
+        size_t inBegin = 0;
+        size_t inEnd = 0;
+
+        /* Unread part of the payload of the last received message */
+        size_t payloadBegin = 0;
+        size_t payloadEnd = 0;
+
+        /* Read from the socket until the buffer holds at least size
+         * bytes of unparsed data */
+        bool fill(size_t size);
+};
+
+#endif
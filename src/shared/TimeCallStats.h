@@ -0,0 +1,78 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_TIMECALLSTATS_H_INCLUDED
+#define LIBTAS_TIMECALLSTATS_H_INCLUDED
+
+#include <stdint.h>
+
+/* An enum indicating which time-getting function query the time */
+enum TimeCallType
+{
+    TIMETYPE_UNTRACKED = -1,
+    TIMETYPE_TIME = 0,
+    TIMETYPE_GETTIMEOFDAY,
+    TIMETYPE_CLOCK,
+    TIMETYPE_CLOCKGETTIME,
+    TIMETYPE_SDLGETTICKS,
+    TIMETYPE_SDLGETPERFORMANCECOUNTER,
+    TIMETYPE_NUMTRACKEDTYPES
+};
+
+/* Number of non-main threads whose queries are also reported one by one,
+ * numbered from 1 in the order of their first time query. The queries of
+ * later threads are only counted in the totals over all non-main threads.
+ */
+#define TIMECALLSTATS_MAXTHREADS 8
+
+/* Statistics of the time queries made by the game during a frame,
+ * sent to the program when tasflags.timecall_stats is set.
+ */
+struct TimeCallStats {
+    /* Frame during which the queries were made */
+    unsigned long frame;
+
+    /* Number of queries of each type by the main thread */
+    uint32_t mainCalls[TIMETYPE_NUMTRACKEDTYPES];
+
+    /* Total number of queries of each type by all the other threads */
+    uint32_t otherCalls[TIMETYPE_NUMTRACKEDTYPES];
+
+    /* Number of times the main timer was force-advanced because of too
+     * many queries */
+    uint32_t forceAdvances;
+
+    /* Total number of times the non-main threads advanced their own clock */
+    uint32_t threadAdvances;
+
+    /* Number of calls to addDelay (sleeps and force-advances of the main
+     * thread) and their total duration in nanoseconds */
+    uint32_t delayCalls;
+    uint64_t delayTotal;
+
+    /* Number of queries of each type and of clock advances of each of the
+     * first non-main threads */
+    uint32_t threadCalls[TIMECALLSTATS_MAXTHREADS][TIMETYPE_NUMTRACKEDTYPES];
+    uint32_t threadClockAdvances[TIMECALLSTATS_MAXTHREADS];
+};
+
+/* Name of each tracked time query type */
+extern const char* const timeCallTypeNames[TIMETYPE_NUMTRACKEDTYPES];
+
+#endif
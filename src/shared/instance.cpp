@@ -0,0 +1,63 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "instance.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+/* Return the instance number, or -1 if running a single instance */
+static int instanceId(void)
+{
+    const char* env = getenv("LIBTAS_INSTANCE");
+    if (!env || !env[0])
+        return -1;
+
+    char* end;
+    long id = strtol(env, &end, 10);
+    if (*end || (id < 0))
+        return -1;
+    return id;
+}
+
+void instanceSocketPath(char* path, size_t len)
+{
+    int id = instanceId();
+    if (id < 0)
+        snprintf(path, len, "/tmp/libTAS.socket");
+    else
+        snprintf(path, len, "/tmp/libTAS-%d.socket", id);
+}
+
+void instanceShmName(char* name, size_t len)
+{
+    int id = instanceId();
+    if (id < 0)
+        snprintf(name, len, "/libtas");
+    else
+        snprintf(name, len, "/libtas-%d", id);
+}
+
+void instanceSaveStatePath(char* path, size_t len)
+{
+    int id = instanceId();
+    if (id < 0)
+        snprintf(path, len, "savestate.bin");
+    else
+        snprintf(path, len, "savestate-%d.bin", id);
+}
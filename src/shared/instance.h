@@ -0,0 +1,45 @@
+/*
+    Copyright 2015-2016 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_INSTANCE_H_INCLUDED
+#define LIBTAS_INSTANCE_H_INCLUDED
+
+#include <stddef.h>
+
+/* Several games can be run at the same time on the same machine, each one
+ * with its own linTAS program. Each pair is identified by an instance number
+ * passed in the LIBTAS_INSTANCE environment variable, so that the files
+ * they share are unique.
+ *
+ * When the variable is not set, we use the same names as a single instance.
+ *
+ * These functions only write into the provided buffer, because they are
+ * called by the memory manager before it is able to allocate anything.
+ */
+
+/* Get the path of the socket file between libTAS and linTAS */
+void instanceSocketPath(char* path, size_t len);
+
+/* Get the name of the shared memory file that holds the game heap */
+void instanceShmName(char* name, size_t len);
+
+/* Get the name of the file that stores the savestate */
+void instanceSaveStatePath(char* path, size_t len);
+
+#endif
@@ -87,6 +87,49 @@ enum {
      * Argument: int
      */
     MSGB_WINDOW_ID,
+
+    /*
+     * During movie playback, send the inputs of a future frame ahead of time,
+     * so that the game does not have to wait for the program at that frame.
+     * Arguments: unsigned long (frame number) then struct AllInputs
+     */
+    MSGN_PREFETCH_INPUTS,
+
+    /*
+     * Tell the game to discard all the inputs that were sent ahead of time,
+     * and to wait for the program at the next frame boundary
+     * Argument: none
+     */
+    MSGN_PREFETCH_FLUSH,
+
+    /*
+     * The game notices the program that it went through a frame boundary
+     * using inputs that were sent ahead of time, without waiting.
+     * Argument: unsigned long (frame number)
+     */
+    MSGB_PREFETCHED_FRAME,
+
+    /*
+     * Send the time spent in each phase of the previous frame boundary.
+     * Only sent when libTAS is built with frame profiling.
+     * Argument: struct FrameTimings
+     */
+    MSGB_FRAME_TIMINGS,
+
+    /*
+     * Send the statistics of the time queries made during the frame.
+     * Only sent when tasflags.timecall_stats is set.
+     * Argument: struct TimeCallStats
+     */
+    MSGB_TIMECALL_STATS,
+
+    /*
+     * Send the statistics of the memory manager at the end of the frame.
+     * Only sent when tasflags.memory_stats is set and the game uses
+     * our memory manager.
+     * Argument: struct MemoryStats
+     */
+    MSGB_MEMORY_STATS,
 };
 
 #endif
@@ -24,11 +24,14 @@ struct TasFlags tasflags = {
     speed_divisor  : 1,
     recording      : -1,
     fastforward    : 0,
+    turbo          : 0,
     includeFlags   : LCF_FILEIO,
     //includeFlags   : LCF_ERROR,
     excludeFlags   : LCF_NONE,
     av_dumping     : 0,
     framerate      : 60,
-    numControllers : 1
+    numControllers : 1,
+    timecall_stats : 0,
+    memory_stats : 0
 }; 
 
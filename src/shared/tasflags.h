@@ -39,6 +39,10 @@ struct TasFlags {
     /* Is fastforward enabled */
     int fastforward;
 
+    /* Is turbo enabled: run as fast as the game logic allows, without
+     * drawing, mixing audio (unless dumping) nor sleeping */
+    int turbo;
+
     /* Which flags trigger a debug message */
     LogCategoryFlag includeFlags;
 
@@ -56,6 +60,12 @@ struct TasFlags {
 
     /* Number of SDL controllers to (virtually) plug in */
     int numControllers;
+
+    /* Send the statistics of time queries to the program at each frame */
+    int timecall_stats;
+
+    /* Send the statistics of the memory manager to the program at each frame */
+    int memory_stats;
 };
 
 extern struct TasFlags tasflags;
@@ -0,0 +1,314 @@
+/* Replay an allocation trace recorded with run.sh --alloctrace, against the
+ * memory manager of libTAS and against the glibc allocator, and report the
+ * time, the peak resident memory and the fragmentation of each one.
+ * Each allocator replays the trace in its own process, from a single thread,
+ * in the order of the records. Every allocated page is written once, like
+ * a game would do.
+ * Usage: benchallocator trace_file [repetitions]
+ * Built with -DBUILD_BENCHMARKS=ON
+ */
+
+#include "../src/libTAS/memory/MemoryManager.h"
+#include "../src/shared/AllocTrace.h"
+#include "../src/shared/Config.h"
+#include "../src/shared/lcf.h"
+#include "../src/shared/instance.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/* The memory manager logs through libTAS, only print its errors */
+void debuglogstdio(LogCategoryFlag lcf, const char* fmt, ...)
+{
+    if (!(lcf & LCF_ERROR))
+        return;
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+}
+
+/* Results of a replay, sent by the child process */
+struct ReplayResult {
+    bool ok;
+    double seconds;
+    long peak_rss_kb;
+    uint64_t peak_live;
+    uint64_t peak_footprint;
+    double fragmentation;
+};
+
+static const int SAMPLE_PERIOD = 1024;
+
+static double realTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* Write each page of a new allocation once */
+static void touch(void* addr, uint64_t size)
+{
+    volatile char* p = static_cast<volatile char*>(addr);
+    for (uint64_t off = 0; off < size; off += 4096)
+        p[off] = 1;
+}
+
+struct GlibcHeap {
+    static const char* name() {return "glibc";}
+    static void* allocate(uint64_t size) {return malloc(size);}
+    static void* allocateZero(uint64_t size) {return calloc(1, size);}
+    static void* allocateAligned(uint64_t size, uint64_t align) {return memalign(align, size);}
+    static void* reallocate(void* addr, uint64_t size) {return realloc(addr, size);}
+    static void deallocate(void* addr) {free(addr);}
+    static uint64_t footprint()
+    {
+#if (__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 33))
+        struct mallinfo2 mi = mallinfo2();
+#else
+        struct mallinfo mi = mallinfo();
+#endif
+        return static_cast<uint64_t>(mi.arena) + mi.hblkhd;
+    }
+};
+
+struct LibTASHeap {
+    static const char* name() {return "libTAS";}
+    static void* allocate(uint64_t size) {return memorymanager.allocate(size, MemoryManager::ALLOC_WRITE, 0);}
+    static void* allocateZero(uint64_t size) {return memorymanager.allocate(size, MemoryManager::ALLOC_WRITE | MemoryManager::ALLOC_ZEROINIT, 0);}
+    static void* allocateAligned(uint64_t size, uint64_t align) {return memorymanager.allocate(size, MemoryManager::ALLOC_WRITE, align);}
+    static void* reallocate(void* addr, uint64_t size) {return memorymanager.reallocate(addr, size, MemoryManager::ALLOC_WRITE);}
+    static void deallocate(void* addr) {memorymanager.deallocate(addr);}
+    static uint64_t footprint()
+    {
+        MemoryStats stats;
+        memorymanager.takeStats(stats);
+        return stats.bytesAllocated;
+    }
+};
+
+/* Open the trace and check its header */
+static FILE* openTrace(const char* path)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Could not open trace %s\n", path);
+        return nullptr;
+    }
+
+    AllocTraceHeader header;
+    if ((fread(&header, sizeof(header), 1, f) != 1) ||
+        memcmp(header.magic, ALLOCTRACE_MAGIC, sizeof(header.magic)) ||
+        (header.version != ALLOCTRACE_VERSION) ||
+        (header.record_size != sizeof(AllocTraceRecord))) {
+        fprintf(stderr, "%s is not a compatible allocation trace\n", path);
+        fclose(f);
+        return nullptr;
+    }
+    return f;
+}
+
+/* Read the next records of the trace. Returns the number of records read */
+static size_t readRecords(FILE* f, AllocTraceRecord* records, size_t count)
+{
+    return fread(records, sizeof(AllocTraceRecord), count, f);
+}
+
+template<class Heap>
+static ReplayResult replay(const char* path, uint32_t max_id)
+{
+    ReplayResult result = {};
+    FILE* f = openTrace(path);
+    if (!f)
+        return result;
+
+    /* Tables indexed by allocation id, allocated outside of both heaps */
+    size_t table_size = (static_cast<size_t>(max_id) + 1) * sizeof(void*);
+    void** ptrs = static_cast<void**>(mmap(nullptr, table_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    uint64_t* sizes = static_cast<uint64_t*>(mmap(nullptr, table_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if ((ptrs == MAP_FAILED) || (sizes == MAP_FAILED)) {
+        fprintf(stderr, "Could not allocate the id tables\n");
+        fclose(f);
+        return result;
+    }
+
+    static AllocTraceRecord records[4096];
+    uint64_t live = 0;
+    uint64_t n = 0;
+    double seconds = 0;
+    size_t count;
+    while ((count = readRecords(f, records, 4096)) > 0) {
+        double start = realTime();
+        for (size_t i = 0; i < count; i++) {
+            const AllocTraceRecord& r = records[i];
+            if ((r.id > max_id) || (r.old_id > max_id))
+                continue;
+
+            switch (r.op) {
+                case ALLOCTRACE_MALLOC:
+                    ptrs[r.id] = Heap::allocate(r.size);
+                    break;
+                case ALLOCTRACE_CALLOC:
+                    ptrs[r.id] = Heap::allocateZero(r.size);
+                    break;
+                case ALLOCTRACE_MEMALIGN:
+                    ptrs[r.id] = Heap::allocateAligned(r.size, static_cast<uint64_t>(1) << r.align_shift);
+                    break;
+                case ALLOCTRACE_REALLOC:
+                    ptrs[r.id] = Heap::reallocate(ptrs[r.old_id], r.size);
+                    ptrs[r.old_id] = nullptr;
+                    live -= sizes[r.old_id];
+                    sizes[r.old_id] = 0;
+                    break;
+                case ALLOCTRACE_FREE:
+                    Heap::deallocate(ptrs[r.id]);
+                    ptrs[r.id] = nullptr;
+                    live -= sizes[r.id];
+                    sizes[r.id] = 0;
+                    continue;
+                default:
+                    continue;
+            }
+
+            if (ptrs[r.id]) {
+                touch(ptrs[r.id], r.size);
+                sizes[r.id] = r.size;
+                live += r.size;
+            }
+
+            if ((++n % SAMPLE_PERIOD) == 0) {
+                uint64_t footprint = Heap::footprint();
+                if (footprint > result.peak_footprint) {
+                    result.peak_footprint = footprint;
+                    result.fragmentation = 1.0 - static_cast<double>(live) / footprint;
+                }
+                if (live > result.peak_live)
+                    result.peak_live = live;
+            }
+        }
+        seconds += realTime() - start;
+    }
+    fclose(f);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    result.peak_rss_kb = usage.ru_maxrss;
+    result.seconds = seconds;
+    result.ok = true;
+    return result;
+}
+
+/* Run the replay in a child process, so that each allocator starts from
+ * a fresh heap and its peak memory is not mixed with the other one */
+template<class Heap>
+static ReplayResult replayInChild(const char* path, uint32_t max_id)
+{
+    ReplayResult result = {};
+    int fds[2];
+    if (pipe(fds) != 0)
+        return result;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        ReplayResult child_result = replay<Heap>(path, max_id);
+        if (write(fds[1], &child_result, sizeof(child_result)) != sizeof(child_result))
+            _exit(1);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    if ((pid < 0) || (read(fds[0], &result, sizeof(result)) != sizeof(result)))
+        result.ok = false;
+    close(fds[0]);
+    if (pid > 0)
+        waitpid(pid, nullptr, 0);
+    return result;
+}
+
+template<class Heap>
+static bool bench(const char* path, uint32_t max_id, int repetitions)
+{
+    /* Keep the fastest run */
+    ReplayResult best = {};
+    for (int i = 0; i < repetitions; i++) {
+        ReplayResult result = replayInChild<Heap>(path, max_id);
+        if (!result.ok) {
+            fprintf(stderr, "Replay with %s failed\n", Heap::name());
+            return false;
+        }
+        if (!best.ok || (result.seconds < best.seconds))
+            best = result;
+    }
+
+    printf("%-8s %10.3f %12ld %12.1f %12.1f %8.1f%%\n", Heap::name(), best.seconds * 1000,
+           best.peak_rss_kb, best.peak_live / (1024.0 * 1024.0),
+           best.peak_footprint / (1024.0 * 1024.0), best.fragmentation * 100);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s trace_file [repetitions]\n", argv[0]);
+        return 1;
+    }
+    const char* path = argv[1];
+    int repetitions = (argc > 2) ? atoi(argv[2]) : 3;
+    if (repetitions < 1)
+        repetitions = 1;
+
+    /* First pass to count the records and size the id tables */
+    FILE* f = openTrace(path);
+    if (!f)
+        return 1;
+
+    static AllocTraceRecord records[4096];
+    uint32_t max_id = 0;
+    uint64_t total = 0;
+    uint32_t threads = 0;
+    uint32_t frames = 0;
+    size_t count;
+    while ((count = readRecords(f, records, 4096)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            if (records[i].id > max_id)
+                max_id = records[i].id;
+            if (records[i].thread >= threads)
+                threads = records[i].thread + 1;
+            if (records[i].frame >= frames)
+                frames = records[i].frame + 1;
+        }
+        total += count;
+    }
+    fclose(f);
+
+    printf("%llu records, %u allocations, %u threads, %u frames\n",
+           static_cast<unsigned long long>(total), max_id, threads, frames);
+    printf("%-8s %10s %12s %12s %12s %9s\n", "heap", "time (ms)", "peak RSS KB", "peak live MB", "peak heap MB", "frag");
+
+    /* Use our own shared memory file, so that we do not interfere with a running game */
+    char instance[16];
+    snprintf(instance, sizeof(instance), "%d", getpid());
+    setenv("LIBTAS_INSTANCE", instance, 1);
+
+    /* Do not duplicate buffered output in the children */
+    fflush(stdout);
+
+    bool ok = bench<GlibcHeap>(path, max_id, repetitions);
+    ok = bench<LibTASHeap>(path, max_id, repetitions) && ok;
+
+    char shm_name[64];
+    instanceShmName(shm_name, sizeof(shm_name));
+    shm_unlink(shm_name);
+
+    return ok ? 0 : 1;
+}
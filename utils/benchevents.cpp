@@ -0,0 +1,191 @@
+/* Measure the cost of the event queue of libTAS on the event mixes and
+ * access patterns of real games, and compare it with a simple queue
+ * of allocated events stored in a list, which is how it used to work.
+ * Each frame, a batch of events is inserted, then the game reads them
+ * either with a SDL_PollEvent() loop, or with one SDL_PeepEvents() call
+ * per category of events followed by a SDL_PollEvent() loop.
+ * Usage: benchevents [frames]
+ * Built with -DBUILD_BENCHMARKS=ON
+ */
+
+#include "../src/libTAS/EventQueue.h"
+#include "../src/shared/lcf.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <set>
+#include <string>
+#include <time.h>
+
+/* The event queue logs through libTAS, and depends on the SDL version */
+int SDLver = 2;
+void debuglogverbose(LogCategoryFlag lcf, std::string str, std::string& outstr) {}
+
+static double realTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* Event types with their proportion in a mix */
+struct EventMix {
+    const char* name;
+    int eventsPerFrame;
+    struct {
+        Uint32 type;
+        int weight;
+    } types[8];
+};
+
+static const EventMix mixes[] = {
+    {"idle", 2, {{SDL_WINDOWEVENT, 3}, {SDL_KEYDOWN, 1}, {SDL_KEYUP, 1}}},
+    {"keyboard", 8, {{SDL_KEYDOWN, 4}, {SDL_KEYUP, 4}, {SDL_WINDOWEVENT, 1}}},
+    {"mouse", 60, {{SDL_MOUSEMOTION, 50}, {SDL_MOUSEBUTTONDOWN, 2}, {SDL_MOUSEBUTTONUP, 2},
+                   {SDL_MOUSEWHEEL, 2}, {SDL_KEYDOWN, 1}, {SDL_KEYUP, 1}, {SDL_WINDOWEVENT, 1}}},
+    {"controller", 40, {{SDL_CONTROLLERAXISMOTION, 30}, {SDL_JOYAXISMOTION, 30},
+                        {SDL_CONTROLLERBUTTONDOWN, 2}, {SDL_CONTROLLERBUTTONUP, 2}, {SDL_WINDOWEVENT, 1}}},
+    {"flood", 2000, {{SDL_MOUSEMOTION, 10}, {SDL_WINDOWEVENT, 5}, {SDL_SYSWMEVENT, 5}, {SDL_KEYDOWN, 1}}},
+};
+
+/* Categories read separately by games, as [min, max] type ranges */
+static const Uint32 categories[][2] = {
+    {SDL_QUIT, SDL_QUIT},
+    {SDL_WINDOWEVENT, SDL_SYSWMEVENT},
+    {SDL_KEYDOWN, SDL_TEXTINPUT},
+    {SDL_MOUSEMOTION, SDL_MOUSEWHEEL},
+    {SDL_JOYAXISMOTION, SDL_JOYDEVICEREMOVED},
+    {SDL_CONTROLLERAXISMOTION, SDL_CONTROLLERDEVICEREMAPPED},
+    {SDL_FINGERDOWN, SDL_FINGERMOTION},
+    {SDL_USEREVENT, SDL_LASTEVENT},
+};
+
+struct RingQueue {
+    static const char* name() {return "ring";}
+    EventQueue queue;
+    RingQueue() {queue.init();}
+    void insert(SDL_Event* ev) {queue.insert(ev);}
+    int pop(SDL_Event* events, int num, Uint32 minType, Uint32 maxType, bool update)
+    {
+        return queue.pop(events, num, minType, maxType, update);
+    }
+};
+
+struct ListQueue {
+    static const char* name() {return "list";}
+    std::list<SDL_Event*> queue;
+    std::set<int> droppedEvents = {SDL_TEXTINPUT, SDL_TEXTEDITING, SDL_SYSWMEVENT};
+    void insert(SDL_Event* ev)
+    {
+        if (droppedEvents.find(ev->type) != droppedEvents.end())
+            return;
+        SDL_Event* copy = new SDL_Event;
+        memcpy(copy, ev, sizeof(SDL_Event));
+        queue.push_back(copy);
+    }
+    int pop(SDL_Event* events, int num, Uint32 minType, Uint32 maxType, bool update)
+    {
+        int evi = 0;
+        for (auto it = queue.begin(); (it != queue.end()) && (evi < num);) {
+            SDL_Event* ev = *it;
+            if ((ev->type < minType) || (ev->type > maxType)) {
+                ++it;
+                continue;
+            }
+            memcpy(&events[evi++], ev, sizeof(SDL_Event));
+            if (update) {
+                delete ev;
+                it = queue.erase(it);
+            }
+            else
+                ++it;
+        }
+        return evi;
+    }
+};
+
+/* Build the sequence of event types of each frame, the same for all queues */
+static void buildTypes(const EventMix& mix, Uint32* types, int count)
+{
+    int total = 0;
+    for (int t = 0; (t < 8) && mix.types[t].weight; t++)
+        total += mix.types[t].weight;
+
+    for (int i = 0; i < count; i++) {
+        int r = rand() % total;
+        int t = 0;
+        while (r >= mix.types[t].weight)
+            r -= mix.types[t++].weight;
+        types[i] = mix.types[t].type;
+    }
+}
+
+template<class Queue>
+static double run(const EventMix& mix, const Uint32* types, int frames, bool byCategory, int* checksum)
+{
+    static Queue queue;
+    static SDL_Event events[64];
+    SDL_Event ev;
+    memset(&ev, 0, sizeof(ev));
+
+    int read = 0;
+    double start = realTime();
+    for (int f = 0; f < frames; f++) {
+        const Uint32* frameTypes = &types[(f % 16) * mix.eventsPerFrame];
+        for (int i = 0; i < mix.eventsPerFrame; i++) {
+            ev.type = frameTypes[i];
+            queue.insert(&ev);
+        }
+
+        if (byCategory) {
+            for (auto& category : categories) {
+                int n;
+                while ((n = queue.pop(events, 64, category[0], category[1], true)) > 0)
+                    read += n;
+            }
+        }
+
+        while (queue.pop(events, 1, SDL_FIRSTEVENT, SDL_LASTEVENT, true))
+            read++;
+    }
+    double elapsed = realTime() - start;
+
+    *checksum = read;
+    return elapsed * 1000000000.0 / frames;
+}
+
+int main(int argc, char** argv)
+{
+    int frames = (argc > 1) ? atoi(argv[1]) : 100000;
+    if (frames < 1)
+        frames = 1;
+
+    printf("%-12s %-10s %12s %12s\n", "mix", "pattern", "list ns/fr", "ring ns/fr");
+
+    for (auto& mix : mixes) {
+        /* Scale down the number of frames for heavy mixes */
+        int mixFrames = frames * 8 / mix.eventsPerFrame;
+        if (mixFrames < 1)
+            mixFrames = 1;
+
+        Uint32* types = new Uint32[16 * mix.eventsPerFrame];
+        srand(1);
+        buildTypes(mix, types, 16 * mix.eventsPerFrame);
+
+        for (int byCategory = 0; byCategory < 2; byCategory++) {
+            int listRead, ringRead;
+            double listTime = run<ListQueue>(mix, types, mixFrames, byCategory, &listRead);
+            double ringTime = run<RingQueue>(mix, types, mixFrames, byCategory, &ringRead);
+            if (listRead != ringRead) {
+                fprintf(stderr, "Queues returned a different number of events (%d and %d)\n", listRead, ringRead);
+                return 1;
+            }
+            printf("%-12s %-10s %12.1f %12.1f\n", mix.name, byCategory ? "category" : "poll", listTime, ringTime);
+        }
+
+        delete[] types;
+    }
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+#!/bin/sh
+
+# Measure the overhead of the frame boundary of libTAS, by playing back a
+# movie on a game that does not render anything.
+# libTAS must be built with -DENABLE_FRAME_PROFILING=ON so that the time
+# spent in each phase is reported, and with -DBUILD_BENCHMARKS=ON to get
+# the benchmark game.
+# Usage: utils/benchframeboundary.sh [number_of_frames] [prefetch_window]
+# This must be run from the root directory, inside an X session.
+
+frames=${1:-10000}
+prefetch=${2:-16}
+
+benchgame=build/benchgame
+movie=/tmp/libTAS-bench.ltm
+
+if [ ! -x $benchgame ]
+then
+    echo "Could not find $benchgame, build with -DBUILD_BENCHMARKS=ON"
+    exit 1
+fi
+
+# Build a movie with no input. It is one frame longer than what the game
+# plays, the game quits by itself after the requested number of frames.
+build/linTAS -w $movie -e $((frames + 1)) || exit 1
+
+./run.sh -b -p $prefetch -r $movie $benchgame $frames
+status=$?
+rm -f $movie
+
+# linTAS returns 1 when the game quits before the end of the movie,
+# which is what is expected here.
+[ $status -le 1 ]
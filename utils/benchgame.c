@@ -0,0 +1,43 @@
+/* Minimal game used to benchmark the frame boundary of libTAS.
+ * It does not render anything, so that the measured time is only the
+ * overhead of libTAS and of the communication with linTAS.
+ * Usage: benchgame [number_of_frames]
+ * Can be compiled with: gcc -o benchgame benchgame.c `pkg-config --libs --cflags sdl2`
+ */
+
+#include <SDL.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv)
+{
+    int frames = 10000;
+    if (argc > 1)
+        frames = atoi(argv[1]);
+
+    SDL_Init(SDL_INIT_VIDEO);
+
+    SDL_Window* window = SDL_CreateWindow("Benchmark",SDL_WINDOWPOS_UNDEFINED,
+            SDL_WINDOWPOS_UNDEFINED,
+            64,
+            64,
+            SDL_WINDOW_HIDDEN);
+
+    int frame;
+    for (frame = 0; frame < frames; frame++) {
+        /* Nothing is drawn, this only triggers a frame boundary */
+        SDL_GL_SwapWindow(window);
+
+        SDL_Event event;
+        while (SDL_PollEvent(&event))
+        {
+            if (event.type == SDL_QUIT)
+                frame = frames;
+        }
+    }
+
+    SDL_DestroyWindow(window);
+
+    SDL_Quit();
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+/* Measure the cost of the time functions that libTAS hooks.
+ * Run it natively and through libTAS to compare the cost of each call,
+ * from the main thread and from another thread.
+ * Usage: benchtime [number_of_calls]
+ * Can be compiled with: gcc -o benchtime benchtime.c `pkg-config --libs --cflags sdl2`
+ */
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+
+static long calls = 1000000;
+
+/* Read the real clock with a direct syscall, which is not hooked */
+static double realTime(void)
+{
+    struct timespec ts;
+    syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* Prevent the compiler from removing the calls */
+static volatile long sink;
+
+static void benchAll(const char* thread)
+{
+    double start;
+    long i;
+
+    start = realTime();
+    for (i = 0; i < calls; i++) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        sink += ts.tv_nsec;
+    }
+    printf("%-6s clock_gettime  %8.1f ns/call\n", thread, (realTime() - start) * 1e9 / calls);
+
+    start = realTime();
+    for (i = 0; i < calls; i++) {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        sink += tv.tv_usec;
+    }
+    printf("%-6s gettimeofday   %8.1f ns/call\n", thread, (realTime() - start) * 1e9 / calls);
+
+    start = realTime();
+    for (i = 0; i < calls; i++)
+        sink += time(NULL);
+    printf("%-6s time           %8.1f ns/call\n", thread, (realTime() - start) * 1e9 / calls);
+
+    start = realTime();
+    for (i = 0; i < calls; i++)
+        sink += SDL_GetTicks();
+    printf("%-6s SDL_GetTicks   %8.1f ns/call\n", thread, (realTime() - start) * 1e9 / calls);
+}
+
+static int workerThread(void *data)
+{
+    benchAll("worker");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+        calls = atol(argv[1]);
+
+    /* libTAS considers the thread calling SDL_Init as the main thread */
+    SDL_Init(SDL_INIT_TIMER);
+
+    benchAll("main");
+
+    SDL_Thread* thread = SDL_CreateThread(workerThread, "worker", NULL);
+    SDL_WaitThread(thread, NULL);
+
+    SDL_Quit();
+    return 0;
+}
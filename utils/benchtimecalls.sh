@@ -0,0 +1,29 @@
+#!/bin/sh
+
+# Compare the cost of the time functions called natively and through libTAS.
+# libTAS must be built with -DBUILD_BENCHMARKS=ON to get the benchmark program.
+# Usage: utils/benchtimecalls.sh [number_of_calls]
+# This must be run from the root directory.
+
+calls=${1:-1000000}
+
+benchtime=build/benchtime
+movie=/tmp/libTAS-benchtime.ltm
+
+if [ ! -x $benchtime ]
+then
+    echo "Could not find $benchtime, build with -DBUILD_BENCHMARKS=ON"
+    exit 1
+fi
+
+echo "Native calls:"
+$benchtime $calls
+
+# The timer of libTAS advances when the time is queried too many times,
+# so the game goes through frame boundaries. Provide a movie with no input
+# that is long enough.
+build/linTAS -w $movie -e 100000 || exit 1
+
+echo "Calls through libTAS:"
+./run.sh -b -r $movie $benchtime $calls
+rm -f $movie
@@ -0,0 +1,113 @@
+/* Check the event queue of libTAS against a simple list of events, with
+ * random insertions and SDL_PeepEvents() type ranges. Ranges are built
+ * around event types on both sides of 0x100, because types below and
+ * above it are not grouped the same way inside the queue.
+ * Usage: checkevents [operations]
+ * Built with -DBUILD_BENCHMARKS=ON
+ */
+
+#include "../src/libTAS/EventQueue.h"
+#include "../src/shared/lcf.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <string>
+
+/* The event queue logs through libTAS, and depends on the SDL version */
+int SDLver = 2;
+void debuglogverbose(LogCategoryFlag lcf, std::string str, std::string& outstr) {}
+
+/* Event types inserted, including dropped ones and one past the last type */
+static const Uint32 types[] = {
+    0x01, 0x11, 0x80, 0xff, SDL_QUIT, SDL_WINDOWEVENT, SDL_SYSWMEVENT,
+    SDL_KEYDOWN, SDL_TEXTINPUT, SDL_MOUSEMOTION, SDL_JOYAXISMOTION,
+    SDL_CONTROLLERAXISMOTION, SDL_USEREVENT, 0xf92e, SDL_LASTEVENT, 0x10000
+};
+static const int numTypes = sizeof(types) / sizeof(types[0]);
+
+static Uint32 randomBound(void)
+{
+    Uint32 type = types[rand() % numTypes];
+    switch (rand() % 4) {
+        case 0:
+            return type - 1;
+        case 1:
+            return type + 1;
+        default:
+            return type;
+    }
+}
+
+static bool isDropped(Uint32 type)
+{
+    return (type == SDL_TEXTINPUT) || (type == SDL_TEXTEDITING) || (type == SDL_SYSWMEVENT);
+}
+
+int main(int argc, char** argv)
+{
+    int operations = (argc > 1) ? atoi(argv[1]) : 1000000;
+
+    EventQueue queue;
+    queue.init();
+    std::list<SDL_Event> reference;
+    static SDL_Event events[16];
+    static SDL_Event expected[16];
+    SDL_Event ev;
+    memset(&ev, 0, sizeof(ev));
+
+    srand(1);
+    for (int op = 0; op < operations; op++) {
+        /* Insert more than we pop so that the queue keeps growing a bit */
+        if ((rand() % 5) < 3) {
+            ev.type = types[rand() % numTypes];
+            ev.window.data1 = op;
+            queue.insert(&ev);
+            if (!isDropped(ev.type))
+                reference.push_back(ev);
+            continue;
+        }
+
+        Uint32 minType = randomBound();
+        Uint32 maxType = randomBound();
+        if (minType > maxType) {
+            Uint32 tmp = minType;
+            minType = maxType;
+            maxType = tmp;
+        }
+        int num = 1 + rand() % 16;
+        bool update = rand() % 2;
+
+        int n = 0;
+        for (auto it = reference.begin(); (it != reference.end()) && (n < num);) {
+            if ((it->type < minType) || (it->type > maxType)) {
+                ++it;
+                continue;
+            }
+            expected[n++] = *it;
+            if (update)
+                it = reference.erase(it);
+            else
+                ++it;
+        }
+
+        int got = queue.pop(events, num, minType, maxType, update);
+        bool same = (got == n);
+        for (int i = 0; same && (i < n); i++)
+            same = (events[i].type == expected[i].type) && (events[i].window.data1 == expected[i].window.data1);
+
+        if (!same) {
+            fprintf(stderr, "Operation %d: pop(%d, 0x%x, 0x%x, %d) returned %d events instead of %d\n",
+                op, num, minType, maxType, update, got, n);
+            return 1;
+        }
+    }
+
+    if (queue.pop(events, 16, SDL_FIRSTEVENT, 0xffffffff, false) != ((reference.size() < 16) ? static_cast<int>(reference.size()) : 16)) {
+        fprintf(stderr, "Queue and reference have a different number of events\n");
+        return 1;
+    }
+
+    printf("%d operations checked\n", operations);
+    return 0;
+}